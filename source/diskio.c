@@ -35,6 +35,12 @@ extern int get_cardstatus(int pdrv);
 extern  struct tm tm;
 #endif
 
+#if defined(__LITEOS_M__) && FF_DSTATUS_CACHE
+static DSTATUS DiskStat[FF_VOLUMES];	/* Cached drive status */
+static DWORD DiskStatCtr[FF_VOLUMES];	/* Number of times the cached status can be returned (0:not valid) */
+static volatile BYTE DiskStatChg[FF_VOLUMES];	/* Change notified by the driver (set by disk_notify() only) */
+#endif
+
 DSTATUS disk_status (
 	BYTE pdrv		/* Physical drive nmuber to identify the drive */
 )
@@ -44,6 +50,19 @@ DSTATUS disk_status (
 #else
 	DSTATUS stat;
 
+#if FF_DSTATUS_CACHE
+	if (pdrv < FF_VOLUMES) {
+		if (!DiskStatChg[pdrv] && DiskStatCtr[pdrv] != 0) {	/* Return the cached status if it is still valid */
+			DiskStatCtr[pdrv]--;
+			return DiskStat[pdrv];
+		}
+		DiskStatChg[pdrv] = 0;	/* Clear it before the query, a change notified during the query is kept for next time */
+		stat = g_diskDrv.drv[pdrv]->disk_status(g_diskDrv.lun[pdrv]);
+		DiskStat[pdrv] = stat;
+		DiskStatCtr[pdrv] = FF_DSTATUS_CACHE;
+		return stat;
+	}
+#endif
 	stat = g_diskDrv.drv[pdrv]->disk_status(g_diskDrv.lun[pdrv]);
 	return stat;
 #endif
@@ -51,6 +70,28 @@ DSTATUS disk_status (
 
 
 
+#if FF_DSTATUS_CACHE
+/*-----------------------------------------------------------------------*/
+/* Notify a Change of the Drive Status                                   */
+/*-----------------------------------------------------------------------*/
+/* This function is called by the driver when the medium is removed or   */
+/* inserted, or its write protection is changed. It can be called from   */
+/* an interrupt handler.                                                 */
+
+void disk_notify (
+	BYTE pdrv		/* Physical drive nmuber to identify the drive */
+)
+{
+#ifndef __LITEOS_M__
+	(void)pdrv;
+#else
+	if (pdrv < FF_VOLUMES) DiskStatChg[pdrv] = 1;	/* Ask the driver at next disk_status() */
+#endif
+}
+#endif
+
+
+
 /*-----------------------------------------------------------------------*/
 /* Inidialize a Drive                                                    */
 /*-----------------------------------------------------------------------*/
@@ -68,6 +109,9 @@ DSTATUS disk_initialize (
 	{
 		stat = g_diskDrv.drv[pdrv]->disk_initialize(g_diskDrv.lun[pdrv]);
 	}
+#if FF_DSTATUS_CACHE
+	if (pdrv < FF_VOLUMES) DiskStatCtr[pdrv] = 0;	/* The status can be changed by initialization */
+#endif
 	return stat;
 #endif
 }
@@ -43,6 +43,9 @@ DRESULT disk_raw_read (int id, void* buff, QWORD sector, UINT32 count);
 DRESULT disk_raw_write (int id, void* buff, QWORD sector, UINT32 count);
 #endif
 DRESULT disk_ioctl (BYTE pdrv, BYTE cmd, void* buff);
+#if FF_DSTATUS_CACHE
+void disk_notify (BYTE pdrv);
+#endif
 #ifdef __LITEOS_M__
 DWORD get_fattime (void);
 #endif
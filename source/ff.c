@@ -125,6 +125,24 @@
 #define FSI_StrucSig		484		/* FAT32 FSI: Structure signature (DWORD) */
 #define FSI_Free_Count		488		/* FAT32 FSI: Number of free clusters (DWORD) */
 #define FSI_Nxt_Free		492		/* FAT32 FSI: Last allocated cluster (DWORD) */
+#define FM_Sig				0		/* Free cluster map: Signature (DWORD) */
+#define FM_Flag				8		/* Free cluster map: Flags (BYTE, b0:valid) */
+#define FM_Csh				9		/* Free cluster map: Clusters per bit in power of 2 (BYTE) */
+#define FM_NumEnt			12		/* Free cluster map: Number of FAT entries (DWORD) */
+#define FM_FreeCnt			16		/* Free cluster map: Number of free clusters (DWORD) */
+#define FM_NxtFree			20		/* Free cluster map: Last allocated cluster (DWORD) */
+#define FM_Map				32		/* Free cluster map: Bit map (1 bit per region, 1:the region may have free clusters) */
+#define DX_Sig				0		/* Directory index: Signature (DWORD) */
+#define DX_NumSec			4		/* Directory index: Number of table sectors (DWORD) */
+#define DX_Map				16		/* Directory index: Map of indexed directories (64-byte) */
+#define SZ_DXS				8		/* Directory index: Size of a slot */
+#define DXS_Clust			0		/* Directory index slot: Start cluster of the directory (DWORD) */
+#define DXS_Tag				4		/* Directory index slot: Tag of the name (WORD) */
+#define DXS_Ofs				6		/* Directory index slot: Entry index of the entry block (WORD) */
+#define RG_Sig				0		/* Ring file: Signature (DWORD) */
+#define RG_Size				4		/* Ring file: Size of the data area (DWORD) */
+#define RG_Head				8		/* Ring file: Offset to be written next (DWORD) */
+#define RG_Used				12		/* Ring file: Amount of data held (DWORD) */
 
 #define MBR_Table			446		/* MBR: Offset of partition table in the MBR */
 #define SZ_PTE				16		/* MBR: Size of a partition table entry */
@@ -146,7 +164,7 @@
 
 /* Re-entrancy related */
 #if FF_FS_REENTRANT
-#if FF_USE_LFN == 1
+#if FF_USE_LFN == 1 && !FF_VOL_LOCAL
 #error Static LFN work area cannot be used at thread-safe configuration
 #endif
 #ifdef __LITEOS_M__
@@ -165,18 +183,39 @@
 #endif
 
 
+#if FF_FS_REENTRANT && FF_FS_MAXHOLD && defined(__LITEOS_M__)
+#error FF_FS_MAXHOLD cannot be used on LiteOS-M (no volume lock)
+#endif
+
+
+#if FF_USE_DIRINDEX && (FF_USE_DIRINDEX < 16 || FF_USE_DIRINDEX > 4096)
+#error Wrong FF_USE_DIRINDEX setting
+#endif
+
+
+#if FF_ALLOC_ZONE < 0 || FF_ALLOC_ZONE > 99
+#error Wrong FF_ALLOC_ZONE setting
+#endif
+#define ZONE_BRD(fs)	((DWORD)((QWORD)((fs)->n_fatent - 2) * FF_ALLOC_ZONE / 100) + 2)	/* First cluster of the large file zone */
+
+
 /* File lock controls */
 #if FF_FS_LOCK != 0
 #if FF_FS_READONLY
 #error FF_FS_LOCK must be 0 at read-only configuration
 #endif
+#endif
+
+
+/* Cluster chain walk guard */
 typedef struct {
-	FATFS *fs;		/* Object ID 1, volume (NULL:blank entry) */
-	DWORD clu;		/* Object ID 2, containing directory (0:root) */
-	DWORD ofs;		/* Object ID 3, offset in the directory */
-	WORD ctr;		/* Object open counter, 0:none, 0x01..0xFF:read mode open count, 0x100:write mode */
-} FILESEM;
+	DWORD lim;		/* Number of links left to be followed */
+#if FF_FS_LOOPCHK
+	DWORD mark;		/* Cluster marked to detect a circular chain */
+	DWORD pow;		/* Number of links to move the mark */
+	DWORD lam;		/* Number of links followed since the mark */
 #endif
+} CHWALK;
 
 
 /* SBCS up-case tables (\x80-\xFF) */
@@ -357,7 +396,24 @@ static BYTE CurrVol;				/* Current drive */
 #endif
 
 #if FF_FS_LOCK != 0
+#if FF_VOL_LOCAL
+#ifndef LOSCFG_FS_FAT_VIRTUAL_PARTITION
+#define LOCKTBL(fs)	((fs)->files)			/* Open object lock semaphores of the volume */
+#else
+#define LOCKTBL(fs)	(PARENTFS(fs)->files)	/* (Virtual partitions share the table of the parent volume) */
+#endif
+#else
 static FILESEM Files[FF_FS_LOCK];	/* Open object lock semaphores */
+#define LOCKTBL(fs)	((void)(fs), Files)	/* (All volumes share the table) */
+#endif
+#endif
+
+#if FF_USE_FILESTAT
+#define FST_ADD(fp, m, n)	((fp)->fst.m += (n))
+#define FST_IO(fp, dr)		((fp)->fst_tick = ff_get_tick(), fst_io(fp, dr))
+#else
+#define FST_ADD(fp, m, n)	((void)0)
+#define FST_IO(fp, dr)		(dr)
 #endif
 
 #if FF_STR_VOLUME_ID
@@ -721,7 +777,14 @@ int lock_fs (		/* 1:Ok, 0:timeout */
 	FATFS* fs		/* Filesystem object */
 )
 {
-	return (fs && ff_req_grant(&fs->sobj)) ? 1 : 0;
+	if (fs && ff_req_grant(&fs->sobj)) {
+#if FF_FS_MAXHOLD
+		fs->htick = ff_get_tick();	/* Start to measure the hold time */
+		fs->hdepth++;				/* The sync object can be locked recursively */
+#endif
+		return 1;
+	}
+	return 0;
 }
 
 
@@ -731,10 +794,75 @@ void unlock_fs (
 )
 {
 	if (fs && res != FR_NOT_ENABLED && res != FR_INVALID_DRIVE && res != FR_TIMEOUT) {
+#if FF_FS_MAXHOLD
+		if (fs->hdepth) fs->hdepth--;
+#endif
 		ff_rel_grant(&fs->sobj);
 	}
 }
 
+
+#if FF_FS_MAXHOLD
+/*-----------------------------------------------------------------------*/
+/* Yield the volume in a long operation                                  */
+/*-----------------------------------------------------------------------*/
+/* A long operation calls hold_due() at its safe points, where the state */
+/* on the volume is consistent, and releases the volume for a moment     */
+/* with hold_yield() when the hold time has exceeded FF_FS_MAXHOLD.      */
+/* The volume is yielded only if it is locked once. On LiteOS-A the      */
+/* mutex is recursive and the caller of the file function may also hold  */
+/* it, so that one unlock would not release it to the waiting tasks.     */
+
+static void hold_start (
+	FATFS* fs,		/* Filesystem object */
+	BYTE op			/* Operation type (HS_xxx) */
+)
+{
+	fs->hop = op + 1;	/* Enable the yield points */
+}
+
+
+static void hold_end (
+	FATFS* fs		/* Filesystem object */
+)
+{
+	DWORD t;
+
+
+	if (fs->hop) {
+		t = ff_get_tick() - fs->htick;
+		if (t > fs->hmax[fs->hop - 1]) fs->hmax[fs->hop - 1] = t;	/* Update the longest hold time */
+		fs->hop = 0;
+	}
+}
+
+
+static int hold_due (	/* 1:The volume should be yielded, 0:Not yet */
+	FATFS* fs		/* Filesystem object */
+)
+{
+	return (fs->hop && ff_get_tick() - fs->htick >= FF_FS_MAXHOLD) ? 1 : 0;
+}
+
+
+static FRESULT hold_yield (	/* FR_OK:The volume is locked again, !=0:The operation cannot be continued */
+	FATFS* fs		/* Filesystem object */
+)
+{
+	BYTE op = fs->hop;
+	WORD id = fs->id;
+
+
+	if (fs->hdepth != 1) return FR_OK;	/* Locked recursively? (the volume cannot be released here) */
+	hold_end(fs);				/* Record the hold time until here */
+	unlock_fs(fs, FR_OK);		/* Let the waiting tasks access the volume */
+	if (!lock_fs(fs)) return FR_TIMEOUT;
+	if (fs->fs_type == 0 || fs->id != id) return FR_INVALID_OBJECT;	/* Has the volume been unmounted? */
+	fs->hop = op;				/* Restore the operation type (it can be changed by other tasks) */
+	return FR_OK;
+}
+#endif
+
 #endif
 
 
@@ -750,14 +878,15 @@ static FRESULT chk_lock (	/* Check if the file can be accessed */
 )
 {
 	UINT i, be;
+	FILESEM *tbl = LOCKTBL(dp->obj.fs);
 
 	/* Search open object table for the object */
 	be = 0;
 	for (i = 0; i < FF_FS_LOCK; i++) {
-		if (Files[i].fs) {	/* Existing entry */
-			if (Files[i].fs == dp->obj.fs &&	 	/* Check if the object matches with an open object */
-				Files[i].clu == dp->obj.sclust &&
-				Files[i].ofs == dp->dptr) break;
+		if (tbl[i].fs) {	/* Existing entry */
+			if (tbl[i].fs == dp->obj.fs &&	 	/* Check if the object matches with an open object */
+				tbl[i].clu == dp->obj.sclust &&
+				tbl[i].ofs == dp->dptr) break;
 		} else {			/* Blank entry */
 			be = 1;
 		}
@@ -767,15 +896,18 @@ static FRESULT chk_lock (	/* Check if the file can be accessed */
 	}
 
 	/* The object was opened. Reject any open against writing file and all write mode open */
-	return (acc != 0 || Files[i].ctr == 0x100) ? FR_LOCKED : FR_OK;
+	return (acc != 0 || tbl[i].ctr == 0x100) ? FR_LOCKED : FR_OK;
 }
 
 
-static int enq_lock (void)	/* Check if an entry is available for a new object */
+static int enq_lock (	/* Check if an entry is available for a new object */
+	FATFS* fs			/* Filesystem object to open the object */
+)
 {
 	UINT i;
+	FILESEM *tbl = LOCKTBL(fs);
 
-	for (i = 0; i < FF_FS_LOCK && Files[i].fs; i++) ;
+	for (i = 0; i < FF_FS_LOCK && tbl[i].fs; i++) ;
 	return (i == FF_FS_LOCK) ? 0 : 1;
 }
 
@@ -786,45 +918,48 @@ UINT inc_lock (	/* Increment object open counter and returns its index (0:Intern
 )
 {
 	UINT i;
+	FILESEM *tbl = LOCKTBL(dp->obj.fs);
 
 
 	for (i = 0; i < FF_FS_LOCK; i++) {	/* Find the object */
-		if (Files[i].fs == dp->obj.fs &&
-			Files[i].clu == dp->obj.sclust &&
-			Files[i].ofs == dp->dptr) break;
+		if (tbl[i].fs == dp->obj.fs &&
+			tbl[i].clu == dp->obj.sclust &&
+			tbl[i].ofs == dp->dptr) break;
 	}
 
 	if (i == FF_FS_LOCK) {				/* Not opened. Register it as new. */
-		for (i = 0; i < FF_FS_LOCK && Files[i].fs; i++) ;
+		for (i = 0; i < FF_FS_LOCK && tbl[i].fs; i++) ;
 		if (i == FF_FS_LOCK) return 0;	/* No free entry to register (int err) */
-		Files[i].fs = dp->obj.fs;
-		Files[i].clu = dp->obj.sclust;
-		Files[i].ofs = dp->dptr;
-		Files[i].ctr = 0;
+		tbl[i].fs = dp->obj.fs;
+		tbl[i].clu = dp->obj.sclust;
+		tbl[i].ofs = dp->dptr;
+		tbl[i].ctr = 0;
 	}
 
-	if (acc >= 1 && Files[i].ctr) return 0;	/* Access violation (int err) */
+	if (acc >= 1 && tbl[i].ctr) return 0;	/* Access violation (int err) */
 
-	Files[i].ctr = Files[i].ctr + 1;		/* Set semaphore value */
+	tbl[i].ctr = tbl[i].ctr + 1;		/* Set semaphore value */
 
 	return i + 1;	/* Index number origin from 1 */
 }
 
 
 static FRESULT dec_lock (	/* Decrement object open counter */
+	FATFS* fs,		/* Filesystem object of the object */
 	UINT i			/* Semaphore index (1..) */
 )
 {
 	WORD n;
 	FRESULT res;
+	FILESEM *tbl = LOCKTBL(fs);
 
 
 	if (--i < FF_FS_LOCK) {	/* Index number origin from 0 */
-		n = Files[i].ctr;
+		n = tbl[i].ctr;
 		if (n == 0x100) n = 0;		/* If write mode open, delete the entry */
 		if (n > 0) n--;				/* Decrement read mode open count */
-		Files[i].ctr = n;
-		if (n == 0) Files[i].fs = 0;	/* Delete the entry if open count gets zero */
+		tbl[i].ctr = n;
+		if (n == 0) tbl[i].fs = 0;	/* Delete the entry if open count gets zero */
 		res = FR_OK;
 	} else {
 		res = FR_INT_ERR;			/* Invalid index nunber */
@@ -838,9 +973,10 @@ static void clear_lock (	/* Clear lock entries of the volume */
 )
 {
 	UINT i;
+	FILESEM *tbl = LOCKTBL(fs);
 
 	for (i = 0; i < FF_FS_LOCK; i++) {
-		if (Files[i].fs == fs) Files[i].fs = 0;
+		if (tbl[i].fs == fs) tbl[i].fs = 0;
 	}
 }
 
@@ -848,15 +984,33 @@ static
 FRESULT empty_lock(FATFS* fs)		/* check lock entries is empty or not. */
 {
 	UINT i;
+	FILESEM *tbl = LOCKTBL(fs);
 
 	for (i = 0; i < FF_FS_LOCK; i++) {
-		if (Files[i].fs == fs) return FR_LOCKED;
+		if (tbl[i].fs == fs) return FR_LOCKED;
 	}
 
 	return FR_OK;
 }
 #endif	/* FF_FS_LOCK != 0 */
 
+
+
+#if FF_USE_FILESTAT
+/*-----------------------------------------------------------------------*/
+/* File I/O counters                                                     */
+/*-----------------------------------------------------------------------*/
+
+static DRESULT fst_io (	/* Returns the result of the disk function */
+	FIL* fp,			/* File object the disk function was called for */
+	DRESULT dr			/* Result of the disk function called at fp->fst_tick */
+)
+{
+	fp->fst.io_tick += ff_get_tick() - fp->fst_tick;	/* Time spent in the disk function */
+	return dr;
+}
+#endif
+
 FRESULT f_checkopenlock(int index)		/* check lock entries is empty or not by index. */
 {
 #if FF_FS_LOCK != 0
@@ -952,6 +1106,138 @@ FRESULT move_window_readdir (	/* Returns FR_OK or FR_DISK_ERR */
 }
 #endif
 
+#if !FF_FS_READONLY && FF_USE_TRIM && FF_TRIM_QUEUE
+/*-----------------------------------------------------------------------*/
+/* Trim queue - Issue, flush, queue and withdraw freed blocks            */
+/*-----------------------------------------------------------------------*/
+
+static void trim_issue (
+	FATFS* fs,		/* Filesystem object */
+	DWORD scl,		/* First cluster of the block */
+	DWORD ecl		/* Last cluster of the block */
+)
+{
+	QWORD sc, ec;
+	DWORD rt[2];
+
+
+	sc = (clst2sect(fs, scl) + fs->tq_gran - 1) & ~((QWORD)fs->tq_gran - 1);	/* Clip the block at the erase block boundary */
+	ec = (clst2sect(fs, ecl) + fs->csize) & ~((QWORD)fs->tq_gran - 1);
+	if (sc >= ec) {				/* No whole erase block in it */
+		fs->tq_stat[3]++;
+		return;
+	}
+	rt[0] = (DWORD)sc;			/* Start of data area freed */
+	rt[1] = (DWORD)(ec - 1);	/* End of data area freed */
+	disk_ioctl(fs->pdrv, CTRL_TRIM, rt);
+	fs->tq_stat[2]++;
+}
+
+
+static void trim_flush (
+	FATFS* fs		/* Filesystem object */
+)
+{
+	UINT i;
+
+#ifdef LOSCFG_FS_FAT_VIRTUAL_PARTITION
+	if (ISCHILD(fs)) fs = PARENTFS(fs);	/* The queue is kept in the parent */
+#endif
+	if (fs->tq_n == 0 || sync_window(fs) != FR_OK) return;	/* The FAT needs to be written before the data is discarded */
+	for (i = 0; i < fs->tq_n; i++) {
+		trim_issue(fs, fs->tq_blk[i][0], fs->tq_blk[i][1]);
+	}
+	fs->tq_n = 0;
+}
+
+
+static void trim_queue (
+	FATFS* fs,		/* Filesystem object */
+	DWORD scl,		/* First cluster of the freed block */
+	DWORD ecl		/* Last cluster of the freed block */
+)
+{
+	UINT i, j, m;
+
+
+	fs->tq_stat[0]++;
+	for (i = 0; i < fs->tq_n && fs->tq_blk[i][0] < scl; i++) ;	/* Find the place in the queue */
+	if (i > 0 && fs->tq_blk[i - 1][1] + 1 >= scl) {			/* Merge it into the previous block */
+		i--;
+		if (fs->tq_blk[i][1] < ecl) fs->tq_blk[i][1] = ecl;
+	} else if (i < fs->tq_n && ecl + 1 >= fs->tq_blk[i][0]) {	/* Merge it into the next block */
+		fs->tq_blk[i][0] = scl;
+		if (fs->tq_blk[i][1] < ecl) fs->tq_blk[i][1] = ecl;
+	} else {												/* Insert a new block */
+		if (fs->tq_n == FF_TRIM_QUEUE) {					/* Trim the largest block to make room if the queue is full */
+			if (sync_window(fs) != FR_OK) {
+				fs->tq_stat[3]++;
+				return;
+			}
+			for (j = m = 0; j < fs->tq_n; j++) {
+				if (fs->tq_blk[j][1] - fs->tq_blk[j][0] > fs->tq_blk[m][1] - fs->tq_blk[m][0]) m = j;
+			}
+			trim_issue(fs, fs->tq_blk[m][0], fs->tq_blk[m][1]);
+			for (j = m; j + 1 < fs->tq_n; j++) {
+				fs->tq_blk[j][0] = fs->tq_blk[j + 1][0];
+				fs->tq_blk[j][1] = fs->tq_blk[j + 1][1];
+			}
+			fs->tq_n--;
+			if (m < i) i--;
+		}
+		for (j = fs->tq_n; j > i; j--) {
+			fs->tq_blk[j][0] = fs->tq_blk[j - 1][0];
+			fs->tq_blk[j][1] = fs->tq_blk[j - 1][1];
+		}
+		fs->tq_blk[i][0] = scl;
+		fs->tq_blk[i][1] = ecl;
+		fs->tq_n++;
+		return;
+	}
+	fs->tq_stat[1]++;
+	if (i + 1 < fs->tq_n && fs->tq_blk[i][1] + 1 >= fs->tq_blk[i + 1][0]) {	/* The gap to the next block is filled */
+		if (fs->tq_blk[i][1] < fs->tq_blk[i + 1][1]) fs->tq_blk[i][1] = fs->tq_blk[i + 1][1];
+		for (j = i + 1; j + 1 < fs->tq_n; j++) {
+			fs->tq_blk[j][0] = fs->tq_blk[j + 1][0];
+			fs->tq_blk[j][1] = fs->tq_blk[j + 1][1];
+		}
+		fs->tq_n--;
+		fs->tq_stat[1]++;
+	}
+}
+
+
+static void trim_take (
+	FATFS* fs,		/* Filesystem object */
+	DWORD clst		/* Cluster to be used again */
+)
+{
+	UINT i, j;
+	DWORD *blk;
+
+
+	for (i = 0; i < fs->tq_n && fs->tq_blk[i][0] <= clst; i++) {
+		blk = fs->tq_blk[i];
+		if (clst > blk[1]) continue;
+		if (clst - blk[0] < blk[1] - clst) {	/* Keep the larger part of the block */
+			blk[0] = clst + 1;
+		} else if (clst != blk[0]) {
+			blk[1] = clst - 1;
+		} else {								/* Remove the block of the cluster */
+			for (j = i; j + 1 < fs->tq_n; j++) {
+				fs->tq_blk[j][0] = fs->tq_blk[j + 1][0];
+				fs->tq_blk[j][1] = fs->tq_blk[j + 1][1];
+			}
+			fs->tq_n--;
+		}
+		break;
+	}
+}
+
+#endif	/* !FF_FS_READONLY && FF_USE_TRIM && FF_TRIM_QUEUE */
+
+
+
 #if !FF_FS_READONLY
 /*-----------------------------------------------------------------------*/
 /* Synchronize filesystem and data on the storage                        */
@@ -1064,6 +1350,123 @@ DWORD get_fat (		/* 0xFFFFFFFF:Disk error, 1:Internal error, 2..0x7FFFFFFF:Clust
 
 
 
+/*-----------------------------------------------------------------------*/
+/* FAT access - Guard a cluster chain walk                               */
+/*-----------------------------------------------------------------------*/
+/* A chain on the broken FAT can be circular. Each link followed in a    */
+/* walk is checked with chain_chk() to stop the walk in bounded time.    */
+
+static void chain_init (
+	CHWALK* cw,		/* Pointer to the walk guard */
+	FATFS* fs,		/* Filesystem object */
+	DWORD clst		/* Top cluster of the walk */
+)
+{
+	cw->lim = fs->n_fatent - 2;	/* A chain cannot have more links than clusters in the volume */
+#if FF_FS_LOOPCHK
+	cw->mark = clst;
+	cw->pow = cw->lam = 1;
+#else
+	(void)clst;
+#endif
+}
+
+
+static int chain_chk (	/* 0:Go ahead, 1:Broken chain (too long or circular) */
+	CHWALK* cw,		/* Pointer to the walk guard */
+	DWORD clst		/* Cluster reached by the link */
+)
+{
+	if (cw->lim == 0) return 1;		/* Too many links */
+	cw->lim--;
+#if FF_FS_LOOPCHK
+	if (clst == cw->mark) return 1;	/* Returned to the marked cluster (Brent's cycle detection) */
+	if (cw->lam == cw->pow) {		/* Move the mark ahead at every power of two links */
+		cw->mark = clst;
+		cw->pow <<= 1;
+		cw->lam = 0;
+	}
+	cw->lam++;
+#else
+	(void)clst;
+#endif
+	return 0;
+}
+
+
+
+
+#if !FF_FS_READONLY && FF_USE_FREEMAP
+/*-----------------------------------------------------------------------*/
+/* FAT access - Free cluster map                                         */
+/*-----------------------------------------------------------------------*/
+/* The map has a bit per region of 2^fm_csh clusters. A cleared bit means */
+/* the region has no free cluster and create_chain() skips it. The bit   */
+/* is set when a cluster in the region is freed.                         */
+
+static int fmap_chk (	/* 1:The region may have free clusters, 0:It has no free cluster */
+	FATFS* fs,		/* Filesystem object */
+	DWORD clst		/* A cluster in the region */
+)
+{
+	clst >>= fs->fm_csh;
+	return (fs->fmap[clst / 8] >> (clst % 8)) & 1;
+}
+
+
+static void fmap_set (
+	FATFS* fs,		/* Filesystem object */
+	DWORD clst,		/* A cluster in the region */
+	int val			/* 1:May have free clusters, 0:No free cluster */
+)
+{
+	clst >>= fs->fm_csh;
+	if (val) {
+		fs->fmap[clst / 8] |= (BYTE)(1 << (clst % 8));
+	} else {
+		fs->fmap[clst / 8] &= (BYTE)~(1 << (clst % 8));
+	}
+}
+
+
+static int fmap_reset (	/* 1:The map has been reset, 0:It did not restrict the search */
+	FATFS* fs		/* Filesystem object */
+)
+{
+	UINT i;
+	int r = 0;
+
+
+	for (i = 0; i < sizeof fs->fmap; i++) {	/* Mark every region 'may have free clusters' */
+		if (fs->fmap[i] != 0xFF) r = 1;
+		fs->fmap[i] = 0xFF;
+	}
+	return r;
+}
+
+
+static FRESULT fmap_drop (	/* FR_OK(0):succeeded, !=0:error */
+	FATFS* fs		/* Filesystem object */
+)
+{
+	FRESULT res;
+	QWORD sect = fs->fm_sect;
+
+
+	fs->fm_sect = 0;
+	res = move_window(fs, sect);
+	if (res == FR_OK) {
+		fs->win[FM_Flag] = 0;		/* Invalidate the snapshot on the disk */
+		fs->wflag = 1;
+		res = sync_window(fs);		/* It needs to be written prior to any change of the FAT */
+	}
+	return res;
+}
+
+#endif
+
+
+
 #if !FF_FS_READONLY
 /*-----------------------------------------------------------------------*/
 /* FAT access - Change value of a FAT entry                              */
@@ -1085,6 +1488,17 @@ FRESULT put_fat (	/* FR_OK(0):succeeded, !=0:error */
 #endif
 
 	if (clst >= 2 && clst < fs->n_fatent) {	/* Check if in valid range */
+#if FF_USE_FREEMAP
+		if (fs->fm_sect != 0) {		/* Invalidate the snapshot of free cluster map at first change of the FAT */
+			res = fmap_drop(fs);
+			if (res != FR_OK) return res;
+		}
+		fs->fm_dirty = 1;			/* The snapshot is to be saved at unmount */
+		if (val == 0) fmap_set(fs, clst, 1);	/* The region has a free cluster */
+#endif
+#if FF_USE_TRIM && FF_TRIM_QUEUE
+		if (val != 0 && fs->tq_n != 0) trim_take(fs, clst);	/* The cluster is not to be trimmed any longer */
+#endif
 		switch (fs->fs_type) {
 		case FS_FAT12 :
 			bc = (UINT)clst; bc += bc / 2;	/* bc: byte offset of the entry */
@@ -1115,6 +1529,9 @@ FRESULT put_fat (	/* FR_OK(0):succeeded, !=0:error */
 			fs->wflag = 1;
 			break;
 		}
+#if FF_FS_REENTRANT && FF_FS_MAXHOLD
+		fs->modcnt++;	/* Tell the FAT scan over a yield point that the FAT has been changed */
+#endif
 	}
 	return res;
 }
@@ -1123,33 +1540,52 @@ FRESULT put_fat (	/* FR_OK(0):succeeded, !=0:error */
 
 
 #if !FF_FS_READONLY
+#if FF_USE_TRIM
 /*-----------------------------------------------------------------------*/
-/* FAT handling - Remove a cluster chain                                 */
+/* FAT handling - Inform the device of a freed contiguous cluster block  */
 /*-----------------------------------------------------------------------*/
 
-FRESULT remove_chain (	/* FR_OK(0):succeeded, !=0:error */
+static void trim_block (
+	FATFS* fs,		/* Filesystem object */
+	DWORD scl,		/* First cluster of the block */
+	DWORD ecl		/* Last cluster of the block */
+)
+{
+#if FF_TRIM_QUEUE
+#ifdef LOSCFG_FS_FAT_VIRTUAL_PARTITION
+	if (ISCHILD(fs)) fs = PARENTFS(fs);	/* The queue is kept in the parent */
+#endif
+	trim_queue(fs, scl, ecl);					/* Trim the block later with the adjacent ones */
+#else
+	DWORD rt[2];
+
+
+	rt[0] = clst2sect(fs, scl);					/* Start of data area freed */
+	rt[1] = clst2sect(fs, ecl) + fs->csize - 1;	/* End of data area freed */
+	disk_ioctl(fs->pdrv, CTRL_TRIM, rt);		/* Inform device the data in the block is no longer needed */
+#endif
+}
+#endif
+
+
+
+/*-----------------------------------------------------------------------*/
+/* FAT handling - Free the clusters of a chain                           */
+/*-----------------------------------------------------------------------*/
+
+static FRESULT free_chain (	/* FR_OK(0):succeeded, !=0:error */
 	FFOBJID* obj,		/* Corresponding object */
-	DWORD clst,			/* Cluster to remove a chain from */
-	DWORD pclst			/* Previous cluster of clst (0 if entire chain) */
+	DWORD clst,			/* Top cluster of the chain to be freed */
+	DWORD* tcl			/* Pending contiguous block to be trimmed {first, last} (last is 0 if no block) */
 )
 {
-	FRESULT res = FR_OK;
+	FRESULT res;
 	DWORD nxt;
 	FATFS *fs = obj->fs;
-#if FF_USE_TRIM
-	DWORD scl = clst, ecl = clst;
-	DWORD rt[2];
-#endif
 
-	if (clst < 2 || clst >= fs->n_fatent) return FR_INT_ERR;	/* Check if in valid range */
 
-	/* Mark the previous cluster 'EOC' on the FAT if it exists */
-	if (pclst) {
-		res = put_fat(fs, pclst, 0xFFFFFFFF);
-		if (res != FR_OK) return res;
-	}
+	if (clst < 2 || clst >= fs->n_fatent) return FR_INT_ERR;	/* Check if in valid range */
 
-	/* Remove the chain */
 	do {
 		nxt = get_fat(obj, clst);			/* Get cluster status */
 		if (nxt == 0) break;				/* Empty cluster? */
@@ -1173,14 +1609,29 @@ FRESULT remove_chain (	/* FR_OK(0):succeeded, !=0:error */
 			PARENTFS(fs)->fsi_flag |= 1;
 		}
 #endif
+#if FF_ALLOC_ZONE
+		fs->zn_full = 0;	/* The zones may have a free cluster again */
+#endif
+#if FF_USE_TRIM
+		if (tcl[1] != 0 && tcl[1] + 1 == clst) {	/* Is the cluster contiguous to the pending block? */
+			tcl[1] = clst;
+		} else {				/* Flush the pending block and start a new one */
+			if (tcl[1] != 0) trim_block(fs, tcl[0], tcl[1]);
+			tcl[0] = tcl[1] = clst;
+		}
+#else
+		(void)tcl;
+#endif
+#if FF_FS_REENTRANT && FF_FS_MAXHOLD
+		if (hold_due(fs)) {	/* Yield the volume if it has been held too long */
 #if FF_USE_TRIM
-		if (ecl + 1 == nxt) {	/* Is next cluster contiguous? */
-			ecl = nxt;
-		} else {				/* End of contiguous cluster block */
-			rt[0] = clst2sect(fs, scl);					/* Start of data area freed */
-			rt[1] = clst2sect(fs, ecl) + fs->csize - 1;	/* End of data area freed */
-			disk_ioctl(fs->pdrv, CTRL_TRIM, rt);		/* Inform device the data in the block is no longer needed */
-			scl = ecl = nxt;
+			if (tcl[1] != 0) {		/* Trim the freed block before other tasks reuse it */
+				trim_block(fs, tcl[0], tcl[1]);
+				tcl[1] = 0;
+			}
+#endif
+			res = hold_yield(fs);
+			if (res != FR_OK) return res;
 		}
 #endif
 		clst = nxt;					/* Next cluster */
@@ -1191,29 +1642,101 @@ FRESULT remove_chain (	/* FR_OK(0):succeeded, !=0:error */
 
 
 
-
 /*-----------------------------------------------------------------------*/
-/* FAT handling - Stretch a chain or Create a new chain                  */
+/* FAT handling - Remove a cluster chain                                 */
 /*-----------------------------------------------------------------------*/
 
-DWORD create_chain (	/* 0:No free cluster, 1:Internal error, 0xFFFFFFFF:Disk error, >=2:New cluster# */
+FRESULT remove_chain (	/* FR_OK(0):succeeded, !=0:error */
 	FFOBJID* obj,		/* Corresponding object */
-	DWORD clst			/* Cluster# to stretch, 0:Create a new chain */
+	DWORD clst,			/* Cluster to remove a chain from */
+	DWORD pclst			/* Previous cluster of clst (0 if entire chain) */
 )
 {
-	DWORD cs, ncl, scl;
-	FRESULT res;
+	FRESULT res = FR_OK;
 	FATFS *fs = obj->fs;
+	DWORD tcl[2] = {0, 0};
 
-#ifdef LOSCFG_FS_FAT_VIRTUAL_PARTITION
-	if (ISVIRPART(fs) && (fs->st_clst == 0xFFFFFFFF || fs->ct_clst == 0xFFFFFFFF)) {
-		return 0;
+	if (clst < 2 || clst >= fs->n_fatent) return FR_INT_ERR;	/* Check if in valid range */
+
+	/* Mark the previous cluster 'EOC' on the FAT if it exists */
+	if (pclst) {
+		res = put_fat(fs, pclst, 0xFFFFFFFF);
+		if (res != FR_OK) return res;
 	}
+
+	/* Remove the chain */
+	res = free_chain(obj, clst, tcl);
+#if FF_USE_TRIM
+	if (tcl[1] != 0) trim_block(fs, tcl[0], tcl[1]);	/* Flush the last block */
 #endif
 
-	if (clst == 0) {	/* Create a new chain */
-		scl = fs->last_clst;				/* Suggested cluster to start to find */
-#ifdef LOSCFG_FS_FAT_VIRTUAL_PARTITION
+	return res;
+}
+
+
+
+
+#if FF_FS_MINIMIZE == 0 && (FF_USE_UNLINK_MANY || FF_USE_RMTREE)
+/*-----------------------------------------------------------------------*/
+/* FAT handling - Remove a set of cluster chains                         */
+/*-----------------------------------------------------------------------*/
+
+#define N_CHBATCH	32	/* Number of cluster chains to be removed at a time */
+
+static FRESULT free_chains (	/* FR_OK(0):succeeded, !=0:error */
+	FFOBJID* obj,		/* Corresponding object */
+	DWORD* clst,		/* Top clusters of the chains to be freed (sorted in this function) */
+	UINT n				/* Number of chains */
+)
+{
+	FRESULT res = FR_OK;
+	DWORD cl, tcl[2] = {0, 0};
+	UINT i, j;
+
+
+	for (i = 1; i < n; i++) {	/* Sort the chains to walk the FAT sectors in ascending order */
+		cl = clst[i];
+		for (j = i; j > 0 && clst[j - 1] > cl; j--) clst[j] = clst[j - 1];
+		clst[j] = cl;
+	}
+	for (i = 0; i < n && res == FR_OK; i++) {
+		res = free_chain(obj, clst[i], tcl);	/* Free the chain (contiguous blocks are merged across the chains) */
+	}
+#if FF_USE_TRIM
+	if (tcl[1] != 0) trim_block(obj->fs, tcl[0], tcl[1]);	/* Flush the last block */
+#endif
+	return res;
+}
+#endif
+
+
+
+
+/*-----------------------------------------------------------------------*/
+/* FAT handling - Stretch a chain or Create a new chain                  */
+/*-----------------------------------------------------------------------*/
+
+DWORD create_chain (	/* 0:No free cluster, 1:Internal error, 0xFFFFFFFF:Disk error, >=2:New cluster# */
+	FFOBJID* obj,		/* Corresponding object */
+	DWORD clst			/* Cluster# to stretch, 0:Create a new chain */
+)
+{
+	DWORD cs, ncl, scl;
+	FRESULT res;
+	FATFS *fs = obj->fs;
+#if FF_USE_FREEMAP
+	int rf;
+#endif
+
+#ifdef LOSCFG_FS_FAT_VIRTUAL_PARTITION
+	if (ISVIRPART(fs) && (fs->st_clst == 0xFFFFFFFF || fs->ct_clst == 0xFFFFFFFF)) {
+		return 0;
+	}
+#endif
+
+	if (clst == 0) {	/* Create a new chain */
+		scl = fs->last_clst;				/* Suggested cluster to start to find */
+#ifdef LOSCFG_FS_FAT_VIRTUAL_PARTITION
 		if (ISVIRPART(fs)) {
 			if (scl == 0 || scl >= fs->n_fatent)
 				scl = fs->st_clst - 1 ;
@@ -1261,6 +1784,12 @@ DWORD create_chain (	/* 0:No free cluster, 1:Internal error, 0xFFFFFFFF:Disk err
 		}
 		cs = get_fat(obj, ncl);						/* Get next cluster status */
 		if (cs == 1 || cs == 0xFFFFFFFF) return cs;	/* Test for error */
+#if FF_ALLOC_ZONE
+#ifdef LOSCFG_FS_FAT_VIRTUAL_PARTITION
+		if (!ISVIRPART(fs))
+#endif
+		if (ncl == ZONE_BRD(fs)) cs = 2;			/* Do not stretch the chain across the zone boundary */
+#endif
 		if (cs != 0) {								/* Not free? */
 #ifdef LOSCFG_FS_FAT_VIRTUAL_PARTITION
 			if (ISVIRPART(fs)) {
@@ -1270,6 +1799,9 @@ DWORD create_chain (	/* 0:No free cluster, 1:Internal error, 0xFFFFFFFF:Disk err
 #endif
 			{
 				cs = fs->last_clst;				/* Start at suggested cluster if it is valid */
+#if FF_ALLOC_NEAR
+				if (fs->alloc_near) cs = 0;		/* Continue from the end of the chain */
+#endif
 				if (cs >= 2 && cs < fs->n_fatent) scl = cs;
 			}
 			ncl = 0;
@@ -1278,6 +1810,9 @@ DWORD create_chain (	/* 0:No free cluster, 1:Internal error, 0xFFFFFFFF:Disk err
 
 	if (ncl == 0) { /* The new cluster cannot be contiguous and find another fragment */
 		ncl = scl;	/* Start cluster */
+#if FF_USE_FREEMAP
+		rf = 0;		/* Current region has not been tested from its top */
+#endif
 		for (;;) {
 			ncl++;				/* Next cluster */
 #ifdef LOSCFG_FS_FAT_VIRTUAL_PARTITION
@@ -1291,14 +1826,44 @@ DWORD create_chain (	/* 0:No free cluster, 1:Internal error, 0xFFFFFFFF:Disk err
 #endif
 			{
 				if (ncl >= fs->n_fatent) {	/* Check wrap-around */
+#if FF_USE_FREEMAP
+					if (rf) fmap_set(fs, fs->n_fatent - 1, 0);	/* The last region has no free cluster */
+					rf = 1;
+#endif
 					ncl = 2;
-					if (ncl > scl) return 0;	/* No free cluster */
+					if (ncl > scl) {		/* No free cluster */
+#if FF_USE_FREEMAP
+						if (fmap_reset(fs)) {	/* Retry without the map if it restricted the search */
+							ncl = scl; rf = 0; continue;
+						}
+#endif
+						return 0;
+					}
+				}
+#if FF_USE_FREEMAP
+				else if ((ncl & (((DWORD)1 << fs->fm_csh) - 1)) == 0) {	/* Top of a region? */
+					if (rf) fmap_set(fs, ncl - 1, 0);	/* The region tested has no free cluster */
+					rf = 1;
+				}
+				if (!fmap_chk(fs, ncl)) {	/* Skip the region with no free cluster unless it has the start cluster */
+					cs = (ncl | (((DWORD)1 << fs->fm_csh) - 1)) + 1;
+					if (scl < ncl || scl >= cs) {
+						ncl = cs - 1; continue;
+					}
 				}
+#endif
 			}
 			cs = get_fat(obj, ncl);				/* Get the cluster status */
 			if (cs == 0) break;				    /* Found a free cluster? */
 			if (cs == 1 || cs == 0xFFFFFFFF) return cs;	/* Test for error */
-			if (ncl == scl) return 0;		    /* No free cluster found? */
+			if (ncl == scl) {				    /* No free cluster found? */
+#if FF_USE_FREEMAP
+				if (fmap_reset(fs)) {		/* Retry without the map if it restricted the search */
+					rf = 0; continue;
+				}
+#endif
+				return 0;
+			}
 		}
 	}
 	res = put_fat(fs, ncl, 0xFFFFFFFF);	/* Mark the new cluster 'EOC' */
@@ -1331,6 +1896,77 @@ DWORD create_chain (	/* 0:No free cluster, 1:Internal error, 0xFFFFFFFF:Disk err
 	return ncl;		/* Return new cluster number or error status */
 }
 
+
+#if FF_ALLOC_NEAR
+/*-----------------------------------------------------------------------*/
+/* FAT handling - Suggest a new chain to be near its directory           */
+/*-----------------------------------------------------------------------*/
+
+static void alloc_near (
+	FATFS* fs,		/* Filesystem object */
+	QWORD sect		/* Sector in the directory table the new object is registered in */
+)
+{
+	DWORD cl = 1;	/* Top of the data area for the static root directory */
+
+
+#ifdef LOSCFG_FS_FAT_VIRTUAL_PARTITION
+	if (!PARENTFS(fs)->alloc_near) return;	/* (The policy is given to the parent volume) */
+#else
+	if (!fs->alloc_near) return;
+#endif
+	if (sect >= fs->database) cl = (DWORD)((sect - fs->database) / fs->csize) + 2;
+	if (cl >= fs->n_fatent) cl = 1;
+	fs->last_clst = cl;	/* The search for a free cluster starts at next to the directory */
+}
+#endif
+
+
+#if FF_ALLOC_ZONE
+/*-----------------------------------------------------------------------*/
+/* FAT handling - Suggest a new cluster in the zone of the file size     */
+/*-----------------------------------------------------------------------*/
+
+static void alloc_zone (
+	FIL* fp,		/* Pointer to the file object */
+	FSIZE_t fsz		/* File size the file is going to reach */
+)
+{
+	FATFS *fs = fp->obj.fs;
+	DWORD cl, cs, scl, lo, hi;
+	int zn;
+
+
+#ifdef LOSCFG_FS_FAT_VIRTUAL_PARTITION
+	if (ISVIRPART(fs)) return;	/* The virtual partition is not divided */
+#endif
+	zn = (fsz >= FF_ZONE_LARGE) ? 1 : 0;	/* Zone of the file size */
+#if FF_USE_STREAM
+	if (fp->st_mode) zn = 1;	/* A stream goes to the large file zone */
+#endif
+	if (fs->zn_full & (1 << zn)) return;	/* The zone is full, search the entire volume */
+	lo = zn ? ZONE_BRD(fs) : 2;
+	hi = zn ? fs->n_fatent : ZONE_BRD(fs);
+	if (lo >= hi) return;
+
+	scl = fs->zn_last[zn];		/* Start at the cluster suggested for the zone */
+	if (scl < lo || scl >= hi) scl = hi - 1;
+	cl = scl;
+	for (;;) {		/* Find a free cluster in the zone */
+		if (++cl >= hi) cl = lo;	/* Wrap-around in the zone */
+		cs = get_fat(&fp->obj, cl);
+		if (cs == 0) break;
+		if (cs == 1 || cs == 0xFFFFFFFF) return;	/* (create_chain() reports the error) */
+		if (cl == scl) {	/* No free cluster in the zone? */
+			fs->zn_full |= 1 << zn;
+			return;
+		}
+	}
+	fs->zn_last[zn] = cl - 1;	/* The cluster is tested first at next time */
+	fs->last_clst = (cl > 2) ? cl - 1 : fs->n_fatent - 1;	/* create_chain() takes the cluster next to the suggested one */
+}
+#endif
+
 #endif /* !FF_FS_READONLY */
 
 
@@ -1366,6 +2002,114 @@ static DWORD clmt_clust (	/* <2:Error, >=2:Cluster number */
 
 
 
+#if !FF_FS_READONLY && FF_USE_STREAM
+/*-----------------------------------------------------------------------*/
+/* Streaming mode - Time, cluster preallocation and release              */
+/*-----------------------------------------------------------------------*/
+
+static DWORD stream_sec (	/* Seconds (monotonic, not continuous at the day boundary) */
+	DWORD tm			/* Time in FAT timestamp format */
+)
+{
+	return (((tm >> 16) * 24 + (tm >> 11 & 31)) * 60 + (tm >> 5 & 63)) * 60 + (tm & 31) * 2;
+}
+
+
+static FRESULT stream_ahead (	/* FR_OK(0):succeeded, !=0:error */
+	FIL* fp,		/* Pointer to the file object */
+	DWORD clst		/* Cluster just entered by the file pointer */
+)
+{
+	DWORD ncl;
+	UINT n;
+
+
+	ncl = get_fat(&fp->obj, clst);
+	if (ncl == 0xFFFFFFFF) return FR_DISK_ERR;
+	if (ncl < 2) return FR_INT_ERR;
+	if (ncl < fp->obj.fs->n_fatent) return FR_OK;	/* Preallocated clusters are left in the chain */
+
+	for (n = FF_STREAM_AHEAD; n; n--) {	/* Stretch the chain ahead of the data */
+#if FF_ALLOC_ZONE
+		alloc_zone(fp, 0);
+#endif
+		ncl = create_chain(&fp->obj, clst);
+		if (ncl == 0) break;			/* Disk full (the data can still be written up to here) */
+		if (ncl == 1) return FR_INT_ERR;
+		if (ncl == 0xFFFFFFFF) return FR_DISK_ERR;
+		clst = ncl;
+	}
+	return FR_OK;
+}
+
+
+static UINT stream_span (	/* Number of sectors to be written in a transfer */
+	FIL* fp,		/* Pointer to the file object */
+	UINT csect,		/* Sector offset in the current cluster */
+	UINT cc			/* Number of sectors to be written (over the current cluster) */
+)
+{
+	FATFS *fs = fp->obj.fs;
+	DWORD clst = fp->clust, ncl;
+	UINT n = fs->csize - csect;
+
+
+	while (cc - n >= fs->csize) {	/* Span the following clusters while they are contiguous */
+		ncl = get_fat(&fp->obj, clst);
+		if (ncl != clst + 1 || ncl >= fs->n_fatent) break;
+		clst = ncl; n += fs->csize;
+	}
+	fp->clust = clst;	/* Cluster of the last sector to be written */
+	return n;
+}
+
+
+static FRESULT stream_trim (	/* FR_OK(0):succeeded, !=0:error */
+	FIL* fp			/* Pointer to the file object */
+)
+{
+	FRESULT res;
+	FATFS *fs = fp->obj.fs;
+	DWORD clst, ncl, bcs;
+	FSIZE_t ofs;
+
+
+	if (fp->obj.objsize == 0) {	/* No data? */
+		if (fp->obj.sclust == 0) return FR_OK;
+		clst = 0; ncl = fp->obj.sclust;	/* Release entire chain */
+	} else {
+		if (fp->fptr == fp->obj.objsize) {	/* Last cluster of the data is known at end of the stream */
+			clst = fp->clust;
+		} else {							/* Follow the chain up to the last cluster of the data */
+			bcs = (DWORD)fs->csize * SS(fs);
+			clst = fp->obj.sclust;
+			for (ofs = fp->obj.objsize; ofs > bcs; ofs -= bcs) {
+				clst = get_fat(&fp->obj, clst);
+				if (clst == 0xFFFFFFFF) return FR_DISK_ERR;
+				if (clst < 2 || clst >= fs->n_fatent) return FR_INT_ERR;
+			}
+		}
+		ncl = get_fat(&fp->obj, clst);
+		if (ncl == 0xFFFFFFFF) return FR_DISK_ERR;
+		if (ncl < 2) return FR_INT_ERR;
+		if (ncl >= fs->n_fatent) return FR_OK;	/* No preallocated cluster */
+	}
+#if FF_FS_REENTRANT && FF_FS_MAXHOLD
+	hold_start(fs, HS_REMOVE);
+#endif
+	res = remove_chain(&fp->obj, ncl, clst);
+#if FF_FS_REENTRANT && FF_FS_MAXHOLD
+	hold_end(fs);
+#endif
+	if (clst == 0) fp->obj.sclust = 0;
+	return res;
+}
+
+#endif	/* !FF_FS_READONLY && FF_USE_STREAM */
+
+
+
+
 /*-----------------------------------------------------------------------*/
 /* Directory handling - Fill a cluster with zeros                        */
 /*-----------------------------------------------------------------------*/
@@ -1373,11 +2117,13 @@ static DWORD clmt_clust (	/* <2:Error, >=2:Cluster number */
 #if !FF_FS_READONLY
 static FRESULT dir_clear (	/* Returns FR_OK or FR_DISK_ERR */
 	FATFS *fs,		/* Filesystem object */
-	DWORD clst		/* Directory table to clear */
+	DWORD clst,		/* Directory table to clear */
+	DWORD ncl		/* Number of contiguous clusters to clear */
 )
 {
-	DWORD sect;
-	UINT n, szb;
+	QWORD sect;
+	DWORD n, nsc;
+	UINT szb;
 	BYTE *ibuf;
 
 #ifdef LOSCFG_FS_FAT_VIRTUAL_PARTITION
@@ -1387,23 +2133,27 @@ static FRESULT dir_clear (	/* Returns FR_OK or FR_DISK_ERR */
 
 	if (sync_window(fs) != FR_OK) return FR_DISK_ERR;	/* Flush disk access window */
 	sect = clst2sect(fs, clst);		/* Top of the cluster */
+	nsc = (DWORD)fs->csize * ncl;	/* Number of sectors to clear */
 	fs->winsect = sect;				/* Set window to top of the cluster */
 	mem_set(fs->win, 0, SS(fs));	/* Clear window buffer */
-#if FF_USE_LFN == 3		/* Quick table clear by using multi-secter write */
+#ifndef __LITEOS_M__	/* Quick table clear by using multi-secter write (ff_memalloc() of LiteOS-M serves only FF_MAX_SS bytes) */
 	/* Allocate a temporary buffer */
-	for (szb = ((DWORD)fs->csize * SS(fs) >= MAX_MALLOC) ? MAX_MALLOC : fs->csize * SS(fs), ibuf = 0; szb > SS(fs) && (ibuf = ff_memalloc(szb)) == 0; szb /= 2) ;
+	for (szb = (nsc * SS(fs) >= MAX_MALLOC) ? MAX_MALLOC : nsc * SS(fs), ibuf = 0; szb > SS(fs) && (ibuf = ff_memalloc(szb)) == 0; szb /= 2) ;
 	if (szb > SS(fs)) {		/* Buffer allocated? */
 		mem_set(ibuf, 0, szb);
 		szb /= SS(fs);		/* Bytes -> Sectors */
-		for (n = 0; n < fs->csize && disk_write(fs->pdrv, ibuf, sect + n, szb) == RES_OK; n += szb) ;	/* Fill the cluster with 0 */
+		for (n = 0; n < nsc; n += szb) {	/* Fill the clusters with 0 */
+			if (szb > nsc - n) szb = (UINT)(nsc - n);
+			if (disk_write(fs->pdrv, ibuf, sect + n, szb) != RES_OK) break;
+		}
 		ff_memfree(ibuf);
 	} else
 #endif
 	{
 		ibuf = fs->win; szb = 1;	/* Use window buffer (many single-sector writes may take a time) */
-		for (n = 0; n < fs->csize && disk_write(fs->pdrv, ibuf, sect + n, szb) == RES_OK; n += szb) ;	/* Fill the cluster with 0 */
+		for (n = 0; n < nsc && disk_write(fs->pdrv, ibuf, sect + n, szb) == RES_OK; n += szb) ;	/* Fill the clusters with 0 */
 	}
-	return (n == fs->csize) ? FR_OK : FR_DISK_ERR;
+	return (n >= nsc) ? FR_OK : FR_DISK_ERR;
 }
 #endif	/* !FF_FS_READONLY */
 
@@ -1499,7 +2249,7 @@ FRESULT dir_next (	/* FR_OK(0):succeeded, FR_NO_FILE:End of table, FR_DENIED:Cou
 					if (clst == 0) return FR_NO_SPACE_LEFT;		/* No free cluster */
 					if (clst == 1) return FR_INT_ERR;			/* Internal error */
 					if (clst == 0xFFFFFFFF) return FR_DISK_ERR;	/* Disk error */
-					if (dir_clear(fs, clst) != FR_OK) return FR_DISK_ERR;	/* Clean up the stretched table */
+					if (dir_clear(fs, clst, 1) != FR_OK) return FR_DISK_ERR;	/* Clean up the stretched table */
 #else
 					if (!stretch) dp->sect = 0;					/* (this line is to suppress compiler warning) */
 					dp->sect = 0; return FR_NO_FILE;			/* Report EOT */
@@ -1529,28 +2279,78 @@ FRESULT dir_next (	/* FR_OK(0):succeeded, FR_NO_FILE:End of table, FR_DENIED:Cou
 
 static FRESULT dir_alloc (	/* FR_OK(0):succeeded, !=0:error */
 	DIR* dp,				/* Pointer to the directory object */
-	UINT nent				/* Number of contiguous entries to allocate */
+	UINT nent,				/* Number of contiguous entries to allocate */
+	DWORD ofs				/* Offset to start to find the block */
 )
 {
 	FRESULT res;
 	UINT n;
 	FATFS *fs = dp->obj.fs;
+#if FF_DIR_ALIGN
+	DWORD fofs = 0xFFFFFFFF, lim = 0;	/* End of the first block found across sectors and end of the scan range */
+	DWORD eofs;
+#endif
 
 
-	res = dir_sdi(dp, 0);
+	res = dir_sdi(dp, ofs ? ofs - SZDIRE : 0);
+	if (res == FR_OK && ofs) res = dir_next(dp, 1);	/* Start at the entry next to it (the table can be stretched) */
 	if (res == FR_OK) {
 		n = 0;
 		do {
 			res = move_window(fs, dp->sect);
 			if (res != FR_OK) break;
 			if (dp->dir[DIR_Name] == DDEM || dp->dir[DIR_Name] == 0) {
+#if FF_DIR_ALIGN
+				if (++n == nent) {	/* A block of contiguous free entries is found */
+					if (nent == 1 || nent > SS(fs) / SZDIRE) break;	/* Any position is fine for a single entry or a block larger than a sector */
+					if ((dp->dptr - (nent - 1) * SZDIRE) / SS(fs) == dp->dptr / SS(fs)) break;	/* It is in a sector */
+					if (fofs == 0xFFFFFFFF) {	/* Hold the first block and continue to find a block in a sector */
+						fofs = dp->dptr;
+						lim = (fofs / SS(fs) + 1 + FF_DIR_ALIGN) * SS(fs);
+					}
+					n--;			/* Slide the block to the next entry */
+				}
+#else
 				if (++n == nent) break;	/* A block of contiguous free entries is found */
+#endif
 			} else {
 				n = 0;					/* Not a blank entry. Restart to search */
 			}
+#if FF_DIR_ALIGN
+			if (fofs != 0xFFFFFFFF) {	/* Do not stretch the table while finding a better block */
+				res = (dp->dptr + SZDIRE >= lim) ? FR_NO_FILE : dir_next(dp, 0);
+				continue;
+			}
+#endif
 			res = dir_next(dp, 1);
 		} while (res == FR_OK);	/* Next entry with table stretch enabled */
 	}
+#if FF_DIR_ALIGN
+	if (fofs != 0xFFFFFFFF) {
+		if (res == FR_NO_FILE) {	/* No block in a sector within the scan range */
+			res = dir_sdi(dp, fofs);	/* Take the first block found */
+		} else if (res == FR_OK) {	/* Skipped blank entries must not terminate the table */
+			eofs = dp->dptr;
+			ofs = fofs - (nent - 1) * SZDIRE;
+			res = dir_sdi(dp, ofs);
+			while (res == FR_OK && ofs < eofs - (nent - 1) * SZDIRE) {
+				res = move_window(fs, dp->sect);
+				if (res != FR_OK) break;
+				if (dp->dir[DIR_Name] == 0) {	/* Mark the skipped end of table as deleted */
+					dp->dir[DIR_Name] = DDEM;
+#ifndef LOSCFG_FS_FAT_VIRTUAL_PARTITION
+					fs->wflag = 1;
+#else
+					PARENTFS(fs)->wflag = 1;
+#endif
+				}
+				res = dir_next(dp, 0);
+				ofs += SZDIRE;
+			}
+			if (res == FR_OK) res = dir_sdi(dp, eofs);
+		}
+	}
+#endif
 
 	if (res == FR_NO_FILE) res = FR_DENIED;	/* No directory entry to allocate */
 	return res;
@@ -1911,11 +2711,13 @@ FRESULT dir_read_massive (
 
 
 /*-----------------------------------------------------------------------*/
-/* Directory handling - Find an object in the directory                  */
+/* Directory handling - Find an object in a range of the directory       */
 /*-----------------------------------------------------------------------*/
 
-FRESULT dir_find (	/* FR_OK(0):succeeded, !=0:error */
-	DIR* dp					/* Pointer to the directory object with the file name */
+static FRESULT dir_scan (	/* FR_OK(0):succeeded, FR_NO_FILE:not found in the range, !=0:error */
+	DIR* dp,				/* Pointer to the directory object with the file name */
+	DWORD ofs,				/* Offset to start to find the object */
+	DWORD nent				/* Number of entries to be scanned */
 )
 {
 	FRESULT res;
@@ -1925,7 +2727,7 @@ FRESULT dir_find (	/* FR_OK(0):succeeded, !=0:error */
 	BYTE a, ord, sum;
 #endif
 
-	res = dir_sdi(dp, 0);			/* Rewind directory object */
+	res = dir_sdi(dp, ofs);			/* Go to the start of the range */
 	if (res != FR_OK) return res;
 
 	/* On the FAT/FAT32 volume */
@@ -1962,6 +2764,7 @@ FRESULT dir_find (	/* FR_OK(0):succeeded, !=0:error */
 		dp->obj.attr = dp->dir[DIR_Attr] & AM_MASK;
 		if (!(dp->dir[DIR_Attr] & AM_VOL) && !mem_cmp(dp->dir, dp->fn, 11)) break;	/* Is it a valid entry? */
 #endif
+		if (--nent == 0) { res = FR_NO_FILE; break; }	/* Reached to end of the range */
 		res = dir_next(dp, 0);	/* Next entry */
 	} while (res == FR_OK);
 
@@ -1969,83 +2772,389 @@ FRESULT dir_find (	/* FR_OK(0):succeeded, !=0:error */
 }
 
 
+
+#if !FF_FS_READONLY && ((FF_USE_BATCH && FF_FS_MINIMIZE == 0) || FF_USE_DIRINDEX)
 /*-----------------------------------------------------------------------*/
-/* Directory handling - Calculate the LFN entry of the directory         */
+/* Hash value of the name                                                */
 /*-----------------------------------------------------------------------*/
 
-DWORD dir_ofs (
-	DIR* dp
+#if (FF_USE_BATCH && FF_FS_MINIMIZE == 0) || !FF_USE_LFN
+static DWORD hash_sfn (	/* Returns hash value of the SFN */
+	const BYTE* sfn		/* Pointer to the SFN */
 )
 {
-#if FF_USE_LFN
-	UINT nlen, nent;
-	DWORD entry;
-	for (nlen = 0; dp->obj.fs->lfnbuf[nlen]; nlen++) ;	/* Get lfn length */
-	nent = (dp->fn[NSFLAG] & NS_LFN) ? (nlen + 12) / 13 + 1 : 1;	/* Number of entries of the lfn */
-	entry = dp->dptr - (nent - 1) * SZDIRE;
-	return entry;
-#else
-	return dp->dptr;
+	DWORD h = 2166136261;
+	UINT i;
+
+
+	for (i = 0; i < 11; i++) {
+		h = (h ^ sfn[i]) * 16777619;
+	}
+	return h;
+}
 #endif
+
+
+#if FF_USE_LFN
+static DWORD hash_lfn (	/* Returns hash value of the LFN (case-insensitive) */
+	const WCHAR* lfn	/* Pointer to the LFN */
+)
+{
+	DWORD h = 2166136261;
+	WCHAR wc;
+
+
+	while ((wc = (WCHAR)ff_wtoupper(*lfn++)) != 0) {
+		h = (h ^ (BYTE)wc) * 16777619;
+		h = (h ^ (BYTE)(wc >> 8)) * 16777619;
+	}
+	return h;
 }
+#endif
 
+#endif	/* FF_USE_BATCH || FF_USE_DIRINDEX */
 
-#if !FF_FS_READONLY
+
+
+
+#if !FF_FS_READONLY && FF_USE_DIRINDEX
 /*-----------------------------------------------------------------------*/
-/* Register an object to the directory                                   */
+/* Directory index                                                       */
 /*-----------------------------------------------------------------------*/
+/* The index is a hash table kept in a contiguous hidden system file in  */
+/* the root directory. Each slot maps the hash of a name in a directory  */
+/* to the offset of its entry block. It is only a hint: every hit is     */
+/* verified against the directory and a miss falls back to the scan.     */
+/* The index is updated only by dir_register() and dir_remove(), so that */
+/* a lookup never writes the volume.                                     */
 
-FRESULT dir_register (	/* FR_OK:succeeded, FR_DENIED:no free entry or too many SFN collision, FR_DISK_ERR:disk error */
-	DIR* dp						/* Target directory with object name to be created */
+#define DX_NAME		"DIRINDEXSYS"	/* SFN of the index file */
+#define DX_MINOFS	(128 * SZDIRE)	/* Entries at or after this offset are indexed */
+#define DX_PROBE	8				/* Number of slots to probe for a name */
+#define DX_SPAN		21				/* Number of entries to verify a hit (max LFN entries + SFN) */
+#define DXT_FREE	0				/* Tag of a free slot */
+#define DXT_DEL		2				/* Tag of a deleted slot (real tags are odd) */
+#define DX_DHASH(cl)	((DWORD)((cl) * 2654435761U))	/* Hash of the start cluster of a directory */
+#define DX_MAPBIT(cl)	(DX_DHASH(cl) >> 23)			/* Bit of the directory in the dx_map[] (0..511) */
+
+static int dix_avail (	/* 0:The directory has no entry in the index, 1:The index may be used */
+	DIR* dp				/* Directory object */
 )
 {
-	FRESULT res;
 	FATFS *fs = dp->obj.fs;
-#if FF_USE_LFN		/* LFN configuration */
-	UINT n, nlen, nent;
-	BYTE sn[12], sum;
+	DWORD i;
 
 
-	if (dp->fn[NSFLAG] & (NS_DOT | NS_NONAME)) return FR_INVALID_NAME;	/* Check name validity */
-	for (nlen = 0; fs->lfnbuf[nlen]; nlen++) ;	/* Get lfn length */
+#ifdef LOSCFG_FS_FAT_VIRTUAL_PARTITION
+	if (ISVIRPART(fs) || ISCHILD(fs)) return 0;
+#endif
+	if (fs->dx_stat != 1) return 0;
+	i = DX_MAPBIT(dp->obj.sclust);
+	return (fs->dx_map[i / 8] >> (i % 8)) & 1;
+}
 
-	/* On the FAT/FAT32 volume */
-	mem_cpy(sn, dp->fn, 12);
-	if (sn[NSFLAG] & NS_LOSS) {			/* When LFN is out of 8.3 format, generate a numbered name */
-		dp->fn[NSFLAG] = NS_NOLFN;		/* Find only SFN */
-		for (n = 1; n < 100; n++) {
-			gen_numname(dp->fn, sn, fs->lfnbuf, n);	/* Generate a numbered name */
-			res = dir_find(dp);				/* Check if the name collides with existing SFN */
-			if (res != FR_OK) break;
-		}
-		if (n == 100) return FR_DENIED;		/* Abort if too many collisions */
-		if (res != FR_NO_FILE) return res;	/* Abort if the result is other than 'not collided' */
-		dp->fn[NSFLAG] = sn[NSFLAG];
-	}
 
-	/* Create an SFN with/without LFNs. */
-	nent = (sn[NSFLAG] & NS_LFN) ? (nlen + 12) / 13 + 1 : 1;	/* Number of entries to allocate */
-	res = dir_alloc(dp, nent);		/* Allocate entries */
-	if (res == FR_OK && --nent) {	/* Set LFN entry if needed */
-		res = dir_sdi(dp, dp->dptr - nent * SZDIRE);
-		if (res == FR_OK) {
-			sum = sum_sfn(dp->fn);	/* Checksum value of the SFN tied to the LFN */
-			do {					/* Store LFN entries in bottom first */
-				res = move_window(fs, dp->sect);
-				if (res != FR_OK) break;
-				put_lfn(fs->lfnbuf, dp->dir, (BYTE)nent, sum);
-#ifndef LOSCFG_FS_FAT_VIRTUAL_PARTITION
-				fs->wflag = 1;
+static DWORD dix_hash (	/* Returns hash value of the name in the directory object */
+	DIR* dp				/* Directory object with the file name */
+)
+{
+#if FF_USE_LFN
+	return hash_lfn(dp->obj.fs->lfnbuf);
 #else
-				PARENTFS(fs)->wflag = 1;
+	return hash_sfn(dp->fn);
 #endif
-				res = dir_next(dp, 0);	/* Next entry */
-			} while (res == FR_OK && --nent);
-		}
-	}
+}
 
-#else	/* Non LFN configuration */
-	res = dir_alloc(dp, 1);		/* Allocate an entry for SFN */
+
+static BYTE* dix_slot (	/* Returns pointer to the home slot in the window, NULL:disk error */
+	DIR* dp,			/* Directory object */
+	DWORD h,			/* Hash value of the name */
+	WORD* tag,			/* Pointer to return the tag of the name */
+	UINT* sn			/* Pointer to return the slot number in the sector */
+)
+{
+	FATFS *fs = dp->obj.fs;
+	DWORD i;
+	UINT nsl = SS(fs) / SZ_DXS;
+
+
+	*tag = (WORD)(h >> 16) | 1;
+	i = (h ^ DX_DHASH(dp->obj.sclust)) % (FF_USE_DIRINDEX * nsl);	/* Home slot in the table */
+	if (move_window(fs, fs->dx_sect + 1 + i / nsl) != FR_OK) return 0;
+	*sn = (UINT)(i % nsl);
+	return fs->win;
+}
+
+
+static FRESULT dix_find (	/* FR_OK(0):found, FR_NO_FILE:not found by the index, !=0:error */
+	DIR* dp				/* Directory object with the file name */
+)
+{
+	FRESULT res;
+	FATFS *fs = dp->obj.fs;
+	BYTE *sl;
+	WORD tag;
+	UINT i, n;
+	DWORD sect;
+
+
+	if ((dp->fn[NSFLAG] & (NS_DOT | NS_NOLFN)) || !dix_avail(dp)) return FR_NO_FILE;
+	if (dix_slot(dp, dix_hash(dp), &tag, &i) == 0) return FR_DISK_ERR;
+	sect = fs->winsect;
+	for (n = 0; n < DX_PROBE; n++, i = (i + 1) % (SS(fs) / SZ_DXS)) {
+		res = move_window(fs, sect);		/* Reload the index sector (verification moves the window) */
+		if (res != FR_OK) return res;
+		sl = fs->win + i * SZ_DXS;
+		if (ld_word(sl + DXS_Tag) == DXT_FREE) break;	/* End of probe */
+		if (ld_word(sl + DXS_Tag) == tag && ld_dword(sl + DXS_Clust) == dp->obj.sclust) {
+			res = dir_scan(dp, (DWORD)ld_word(sl + DXS_Ofs) * SZDIRE, DX_SPAN);	/* Verify the hit */
+			if (res == FR_OK || res == FR_DISK_ERR) return res;
+		}
+	}
+	return FR_NO_FILE;
+}
+
+
+static void dix_create (
+	FATFS* fs		/* Filesystem object */
+)
+{
+	FFOBJID obj;
+	DIR dj;
+	DWORD ncl, scl, cl, n;
+
+
+	fs->dx_stat = 2;					/* Do not try again on failure */
+	ncl = (1 + FF_USE_DIRINDEX + fs->csize - 1) / fs->csize;	/* Number of clusters for the index file */
+
+	/* Find a contiguous free cluster block */
+	obj.fs = fs;
+	scl = n = 0;
+	for (cl = 2; cl < fs->n_fatent && n < ncl; cl++) {
+		if (n == 0) scl = cl;
+		switch (get_fat(&obj, cl)) {
+		case 0: n++; break;
+		case 1: case 0xFFFFFFFF: return;
+		default: n = 0;
+		}
+	}
+	if (n < ncl) return;
+
+	/* Register the index file */
+	dj.obj.fs = fs;
+	dj.obj.sclust = 0;					/* Root directory */
+	mem_cpy(dj.fn, DX_NAME, 11);
+	dj.fn[NSFLAG] = 0;
+	if (dir_alloc(&dj, 1, 0) != FR_OK) return;
+
+	/* Allocate and clear the table */
+	for (cl = scl; cl < scl + ncl; cl++) {
+		if (put_fat(fs, cl, (cl + 1 < scl + ncl) ? cl + 1 : 0xFFFFFFFF) != FR_OK) return;
+	}
+	if (fs->free_clst <= fs->n_fatent - 2) fs->free_clst -= ncl;
+	fs->fsi_flag |= 1;
+	if (dir_clear(fs, scl, ncl) != FR_OK) return;
+	fs->dx_sect = clst2sect(fs, scl);
+	if (move_window(fs, fs->dx_sect) != FR_OK) return;
+	st_dword(fs->win + DX_Sig, 0x58444944);	/* "DIDX" */
+	st_dword(fs->win + DX_NumSec, FF_USE_DIRINDEX);
+	fs->wflag = 1;
+
+	/* Create the entry */
+	if (move_window(fs, dj.sect) != FR_OK) return;
+	mem_set(dj.dir, 0, SZDIRE);
+	mem_cpy(dj.dir + DIR_Name, DX_NAME, 11);
+	dj.dir[DIR_Attr] = AM_HID | AM_SYS;
+	st_clust(fs, dj.dir, scl);
+	st_dword(dj.dir + DIR_FileSize, (1 + FF_USE_DIRINDEX) * SS(fs));
+	fs->wflag = 1;
+	mem_set(fs->dx_map, 0, sizeof fs->dx_map);
+	fs->dx_stat = 1;
+}
+
+
+static FRESULT dix_put (	/* FR_OK(0):succeeded, !=0:failed to restore the window */
+	DIR* dp,			/* Directory object pointing the entry found or created */
+	DWORD ofs			/* Offset of the entry block */
+)
+{
+	FATFS *fs = dp->obj.fs;
+	BYTE *sl;
+	WORD tag;
+	UINT i, n, v;
+	DWORD b;
+
+
+#ifdef LOSCFG_FS_FAT_VIRTUAL_PARTITION
+	if (ISVIRPART(fs) || ISCHILD(fs)) return FR_OK;
+#endif
+	if (ofs < DX_MINOFS || (dp->fn[NSFLAG] & (NS_DOT | NS_NOLFN))) return FR_OK;	/* Not worth to index */
+	if (fs->dx_stat == 0) dix_create(fs);
+	if (fs->dx_stat == 1 && dix_slot(dp, dix_hash(dp), &tag, &i) != 0) {
+		for (n = 0, v = i; n < DX_PROBE; n++, i = (i + 1) % (SS(fs) / SZ_DXS)) {	/* Find a slot to store */
+			sl = fs->win + i * SZ_DXS;
+			if (ld_word(sl + DXS_Tag) == DXT_FREE) { v = i; break; }
+			if (ld_word(sl + DXS_Tag) == tag && ld_dword(sl + DXS_Clust) == dp->obj.sclust) { v = i; break; }
+			if (ld_word(sl + DXS_Tag) == DXT_DEL) v = i;
+		}
+		sl = fs->win + v * SZ_DXS;		/* Overwrite the home slot if no slot is available */
+		st_dword(sl + DXS_Clust, dp->obj.sclust);
+		st_word(sl + DXS_Tag, tag);
+		st_word(sl + DXS_Ofs, (WORD)(ofs / SZDIRE));
+		fs->wflag = 1;
+		b = DX_MAPBIT(dp->obj.sclust);
+		if (!((fs->dx_map[b / 8] >> (b % 8)) & 1) && move_window(fs, fs->dx_sect) == FR_OK) {	/* Mark the directory in the map */
+			fs->dx_map[b / 8] |= 1 << (b % 8);
+			mem_cpy(fs->win + DX_Map, fs->dx_map, sizeof fs->dx_map);
+			fs->wflag = 1;
+		}
+	}
+	return move_window(fs, dp->sect);	/* Restore the window to the entry */
+}
+
+
+#if FF_FS_MINIMIZE == 0
+static void dix_del (
+	DIR* dp,			/* Directory object pointing the entry to be removed */
+	DWORD ofs			/* Offset of the entry block */
+)
+{
+	FATFS *fs = dp->obj.fs;
+	BYTE *sl;
+	WORD tag;
+	UINT i, n;
+	DWORD h;
+#if FF_USE_LFN
+	DIR dj;
+	WCHAR wc;
+#endif
+
+
+	if (ofs < DX_MINOFS || !dix_avail(dp)) return;
+
+	/* Get hash value of the name in the entry block (the name in the directory object can be another one) */
+#if FF_USE_LFN
+	mem_cpy(&dj, dp, sizeof (DIR));
+	if (dir_sdi(&dj, ofs) != FR_OK || dir_read(&dj, 0) != FR_OK) return;
+	if (dj.blk_ofs == 0xFFFFFFFF) {	/* No LFN, make the name from the SFN */
+		for (i = n = 0; i < 11; i++) {
+			wc = dj.dir[i];
+			if (wc == ' ') continue;
+			if (wc == RDDEM) wc = DDEM;
+			if (i == 8) fs->lfnbuf[n++] = '.';	/* Insert a . if extension is exist */
+			if (dbc_1st((BYTE)wc) && i != 7 && i != 10 && dbc_2nd(dj.dir[i + 1])) {	/* Make a DBC if needed */
+				wc = wc << 8 | dj.dir[++i];
+			}
+			wc = ff_oem2uni(wc, CODEPAGE);
+			if (wc == 0) return;
+			fs->lfnbuf[n++] = wc;
+		}
+		fs->lfnbuf[n] = 0;
+	}
+	h = hash_lfn(fs->lfnbuf);
+#else
+	if (move_window(fs, dp->sect) != FR_OK) return;
+	h = hash_sfn(dp->dir);
+#endif
+	if (dix_slot(dp, h, &tag, &i) == 0) return;
+	for (n = 0; n < DX_PROBE; n++, i = (i + 1) % (SS(fs) / SZ_DXS)) {
+		sl = fs->win + i * SZ_DXS;
+		if (ld_word(sl + DXS_Tag) == DXT_FREE) break;
+		if (ld_dword(sl + DXS_Clust) == dp->obj.sclust && ld_word(sl + DXS_Ofs) == ofs / SZDIRE) {
+			st_word(sl + DXS_Tag, DXT_DEL);
+			fs->wflag = 1;
+		}
+	}
+}
+#endif
+
+#endif	/* !FF_FS_READONLY && FF_USE_DIRINDEX */
+
+
+
+
+/*-----------------------------------------------------------------------*/
+/* Directory handling - Find an object in the directory                  */
+/*-----------------------------------------------------------------------*/
+
+FRESULT dir_find (	/* FR_OK(0):succeeded, !=0:error */
+	DIR* dp					/* Pointer to the directory object with the file name */
+)
+{
+	FRESULT res;
+
+
+#if !FF_FS_READONLY && FF_USE_DIRINDEX
+	if (dix_find(dp) == FR_OK) return FR_OK;	/* Try the directory index first (any failure of the index is a miss) */
+#endif
+	res = dir_scan(dp, 0, MAX_DIR / SZDIRE);
+	return res;
+}
+
+
+/*-----------------------------------------------------------------------*/
+/* Directory handling - Calculate the LFN entry of the directory         */
+/*-----------------------------------------------------------------------*/
+
+DWORD dir_ofs (
+	DIR* dp
+)
+{
+#if FF_USE_LFN
+	UINT nlen, nent;
+	DWORD entry;
+	for (nlen = 0; dp->obj.fs->lfnbuf[nlen]; nlen++) ;	/* Get lfn length */
+	nent = (dp->fn[NSFLAG] & NS_LFN) ? (nlen + 12) / 13 + 1 : 1;	/* Number of entries of the lfn */
+	entry = dp->dptr - (nent - 1) * SZDIRE;
+	return entry;
+#else
+	return dp->dptr;
+#endif
+}
+
+
+#if !FF_FS_READONLY
+/*-----------------------------------------------------------------------*/
+/* Register an object to the directory                                   */
+/*-----------------------------------------------------------------------*/
+
+static FRESULT dir_store (	/* FR_OK:succeeded, FR_DENIED:no free entry, FR_DISK_ERR:disk error */
+	DIR* dp,					/* Target directory with object name to be created */
+	DWORD ofs					/* Offset to start to find the free entries */
+)
+{
+	FRESULT res;
+	FATFS *fs = dp->obj.fs;
+#if FF_USE_LFN		/* LFN configuration */
+	UINT nlen, nent;
+	BYTE sum;
+
+
+	for (nlen = 0; fs->lfnbuf[nlen]; nlen++) ;	/* Get lfn length */
+
+	/* Create an SFN with/without LFNs. */
+	nent = (dp->fn[NSFLAG] & NS_LFN) ? (nlen + 12) / 13 + 1 : 1;	/* Number of entries to allocate */
+	res = dir_alloc(dp, nent, ofs);	/* Allocate entries */
+	if (res == FR_OK && --nent) {	/* Set LFN entry if needed */
+		res = dir_sdi(dp, dp->dptr - nent * SZDIRE);
+		if (res == FR_OK) {
+			sum = sum_sfn(dp->fn);	/* Checksum value of the SFN tied to the LFN */
+			do {					/* Store LFN entries in bottom first */
+				res = move_window(fs, dp->sect);
+				if (res != FR_OK) break;
+				put_lfn(fs->lfnbuf, dp->dir, (BYTE)nent, sum);
+#ifndef LOSCFG_FS_FAT_VIRTUAL_PARTITION
+				fs->wflag = 1;
+#else
+				PARENTFS(fs)->wflag = 1;
+#endif
+				res = dir_next(dp, 0);	/* Next entry */
+			} while (res == FR_OK && --nent);
+		}
+	}
+
+#else	/* Non LFN configuration */
+	res = dir_alloc(dp, 1, ofs);	/* Allocate an entry for SFN */
 
 #endif
 
@@ -2069,6 +3178,48 @@ FRESULT dir_register (	/* FR_OK:succeeded, FR_DENIED:no free entry or too many S
 	return res;
 }
 
+
+FRESULT dir_register (	/* FR_OK:succeeded, FR_DENIED:no free entry or too many SFN collision, FR_DISK_ERR:disk error */
+	DIR* dp						/* Target directory with object name to be created */
+)
+{
+#if FF_USE_LFN		/* LFN configuration */
+	FRESULT res;
+	FATFS *fs = dp->obj.fs;
+	UINT n;
+	BYTE sn[12];
+#elif FF_USE_DIRINDEX
+	FRESULT res;
+#endif
+
+
+#if FF_USE_LFN
+	if (dp->fn[NSFLAG] & (NS_DOT | NS_NONAME)) return FR_INVALID_NAME;	/* Check name validity */
+
+	/* On the FAT/FAT32 volume */
+	mem_cpy(sn, dp->fn, 12);
+	if (sn[NSFLAG] & NS_LOSS) {			/* When LFN is out of 8.3 format, generate a numbered name */
+		dp->fn[NSFLAG] = NS_NOLFN;		/* Find only SFN */
+		for (n = 1; n < 100; n++) {
+			gen_numname(dp->fn, sn, fs->lfnbuf, n);	/* Generate a numbered name */
+			res = dir_find(dp);				/* Check if the name collides with existing SFN */
+			if (res != FR_OK) break;
+		}
+		if (n == 100) return FR_DENIED;		/* Abort if too many collisions */
+		if (res != FR_NO_FILE) return res;	/* Abort if the result is other than 'not collided' */
+		dp->fn[NSFLAG] = sn[NSFLAG];
+	}
+#endif
+
+#if FF_USE_DIRINDEX
+	res = dir_store(dp, 0);		/* Store the entry block at the first free space */
+	if (res == FR_OK) res = dix_put(dp, dir_ofs(dp));	/* Record the entry created deep in the directory */
+	return res;
+#else
+	return dir_store(dp, 0);	/* Store the entry block at the first free space */
+#endif
+}
+
 #endif /* !FF_FS_READONLY */
 
 
@@ -2086,6 +3237,9 @@ FRESULT dir_remove (	/* FR_OK:Succeeded, FR_DISK_ERR:A disk error */
 	FATFS *fs = dp->obj.fs;
 #if FF_USE_LFN		/* LFN configuration */
 	DWORD last = dp->dptr;
+#if FF_USE_DIRINDEX
+	dix_del(dp, (dp->blk_ofs != 0xFFFFFFFF) ? dp->blk_ofs : dp->dptr);	/* Drop the entry from the directory index */
+#endif
 	res = (dp->blk_ofs == 0xFFFFFFFF) ? FR_OK : dir_sdi(dp, dp->blk_ofs);	/* Goto top of the entry block if LFN is exist */
 	if (res == FR_OK) {
 		do {
@@ -2106,6 +3260,9 @@ FRESULT dir_remove (	/* FR_OK:Succeeded, FR_DISK_ERR:A disk error */
 	}
 #else			/* Non LFN configuration */
 
+#if FF_USE_DIRINDEX
+	dix_del(dp, dp->dptr);		/* Drop the entry from the directory index */
+#endif
 	res = move_window(fs, dp->sect);
 	if (res == FR_OK) {
 		dp->dir[DIR_Name] = DDEM;	/* Mark the entry 'deleted'.*/
@@ -2229,7 +3386,7 @@ void get_fileinfo (
 
 
 
-#if FF_USE_FIND && FF_FS_MINIMIZE <= 1
+#if (FF_USE_FIND && FF_FS_MINIMIZE <= 1) || (FF_USE_UNLINK_MANY && !FF_FS_READONLY && FF_FS_MINIMIZE == 0)
 /*-----------------------------------------------------------------------*/
 /* Pattern matching                                                      */
 /*-----------------------------------------------------------------------*/
@@ -2304,7 +3461,7 @@ static int pattern_matching (	/* 0:not matched, 1:matched */
 	return 0;
 }
 
-#endif /* FF_USE_FIND && FF_FS_MINIMIZE <= 1 */
+#endif /* (FF_USE_FIND && FF_FS_MINIMIZE <= 1) || (FF_USE_UNLINK_MANY && !FF_FS_READONLY && FF_FS_MINIMIZE == 0) */
 
 
 
@@ -2509,8 +3666,9 @@ FRESULT create_name (		/* FR_OK: successful, FR_INVALID_NAME: could not create *
 /* Follow a file path                                                    */
 /*-----------------------------------------------------------------------*/
 
-static FRESULT follow_path (	/* FR_OK(0): successful, !=0: error code */
+static FRESULT follow_path_at (	/* FR_OK(0): successful, !=0: error code */
 	DIR* dp,					/* Directory object to return last directory and found object */
+	const DIR* base,			/* Directory a relative path starts from (NULL:current directory) */
 	const TCHAR* path			/* Full-path string to find a file or directory */
 )
 {
@@ -2519,6 +3677,9 @@ static FRESULT follow_path (	/* FR_OK(0): successful, !=0: error code */
 	FATFS *fs = dp->obj.fs;
 
 
+	if (base && *path != '/' && *path != '\\') {	/* Relative to the base directory */
+		dp->obj.sclust = base->obj.sclust;
+	} else
 #if FF_FS_RPATH != 0
 	if (*path != '/' && *path != '\\') {	/* Without heading separator */
 		dp->obj.sclust = fs->cdir;				/* Start from current directory */
@@ -2567,6 +3728,8 @@ static FRESULT follow_path (	/* FR_OK(0): successful, !=0: error code */
 	return res;
 }
 
+#define follow_path(dp, path)	follow_path_at(dp, 0, path)
+
 
 
 
@@ -2644,6 +3807,178 @@ static int get_ldnumber (	/* Returns logical drive number (-1:invalid drive numb
 
 
 
+#if !FF_FS_READONLY && FF_USE_FREEMAP
+/*-----------------------------------------------------------------------*/
+/* Load/Save snapshot of the free cluster map                            */
+/*-----------------------------------------------------------------------*/
+/* The snapshot is stored in a hidden system file in the root directory  */
+/* at unmount if the FAT has been changed. It is taken at next mount     */
+/* only if the FAT has not been changed since then, and is invalidated   */
+/* at the first change of the FAT.                                       */
+
+#define FM_NAME		"FREEMAP SYS"	/* SFN of the snapshot file */
+
+static void fmap_load (
+	FATFS* fs		/* Filesystem object just mounted */
+)
+{
+	DIR dj;
+	DWORD cl;
+	QWORD sect;
+	BYTE csh;
+
+
+	for (csh = 0; (fs->n_fatent - 1) >> csh >= sizeof fs->fmap * 8; csh++) ;	/* Region size to cover the volume */
+	fs->fm_csh = csh;
+	fs->fm_sect = 0;
+	fs->fm_dirty = 0;
+	fmap_reset(fs);						/* Every region may have free clusters */
+
+	/* Check if the volume has been shut down cleanly by other systems (FAT12 has no flag for it) */
+	if (fs->fs_type == FS_FAT12 || move_window(fs, fs->fatbase) != FR_OK) return;
+	if (fs->fs_type == FS_FAT16 && !(ld_word(fs->win + 2) & 0x8000)) return;
+	if (fs->fs_type == FS_FAT32 && !(ld_dword(fs->win + 4) & 0x08000000)) return;
+
+	/* Find the snapshot */
+	dj.obj.fs = fs;
+	dj.obj.sclust = 0;					/* Root directory */
+	mem_cpy(dj.fn, FM_NAME, 11);
+	dj.fn[NSFLAG] = NS_NOLFN;			/* Find only SFN */
+	if (dir_find(&dj) != FR_OK) return;
+	cl = ld_clust(fs, dj.dir);
+	if (cl < 2 || cl >= fs->n_fatent || ld_dword(dj.dir + DIR_FileSize) < SS(fs)) return;
+	sect = clst2sect(fs, cl);
+	if (sect == 0 || move_window(fs, sect) != FR_OK) return;
+
+	/* Check validity of the snapshot */
+	if (ld_dword(fs->win + FM_Sig) != 0x50414D46) return;	/* "FMAP" */
+	if (!(fs->win[FM_Flag] & 1)) return;		/* The FAT has been changed after the snapshot was saved */
+	if (fs->win[FM_Csh] != csh || ld_dword(fs->win + FM_NumEnt) != fs->n_fatent) return;	/* Another volume */
+	if (!(fs->fsi_flag & 0x80)				/* FSInfo has been updated by other systems? */
+		&& (ld_dword(fs->win + FM_FreeCnt) != fs->free_clst || ld_dword(fs->win + FM_NxtFree) != fs->last_clst)) return;
+
+	/* Take the snapshot (it saves the full FAT scan of f_getfree() on the volume without FSInfo) */
+	fs->free_clst = ld_dword(fs->win + FM_FreeCnt);
+	fs->last_clst = ld_dword(fs->win + FM_NxtFree);
+	mem_cpy(fs->fmap, fs->win + FM_Map, sizeof fs->fmap);
+	fs->fm_sect = sect;					/* It is to be invalidated at first change of the FAT */
+}
+
+
+static FRESULT fmap_save (	/* FR_OK(0):succeeded, !=0:error */
+	FATFS* fs		/* Filesystem object to be unmounted */
+)
+{
+	FRESULT res;
+	DIR dj;
+	DWORD cl = 0;
+	QWORD sect;
+	DEF_NAMBUF
+
+
+	if (fs->fm_sect != 0 || !fs->fm_dirty) return FR_OK;	/* The snapshot on the disk is still valid or the FAT has not been changed */
+	INIT_NAMBUF(fs);
+	dj.obj.fs = fs;
+	dj.obj.sclust = 0;					/* Root directory */
+	mem_cpy(dj.fn, FM_NAME, 11);
+	dj.fn[NSFLAG] = NS_NOLFN;			/* Find only SFN */
+	res = dir_find(&dj);
+	if (res == FR_NO_FILE) {			/* Create the snapshot file if not exist */
+#if FF_USE_LFN
+		fs->lfnbuf[0] = 0;
+#endif
+		dj.fn[NSFLAG] = 0;
+		res = dir_register(&dj);
+		if (res == FR_OK) {
+			cl = create_chain(&dj.obj, 0);
+			if (cl == 0) res = FR_DENIED;
+			if (cl == 1) res = FR_INT_ERR;
+			if (cl == 0xFFFFFFFF) res = FR_DISK_ERR;
+		}
+		if (res == FR_OK) res = move_window(fs, dj.sect);
+		if (res == FR_OK) {
+			dj.dir[DIR_Attr] = AM_HID | AM_SYS;
+			st_clust(fs, dj.dir, cl);
+			st_dword(dj.dir + DIR_FileSize, SS(fs));
+			fs->wflag = 1;
+		}
+	} else if (res == FR_OK) {
+		cl = ld_clust(fs, dj.dir);
+		if (cl < 2 || cl >= fs->n_fatent || ld_dword(dj.dir + DIR_FileSize) < SS(fs)) res = FR_DENIED;	/* Not a snapshot file */
+	}
+	if (res == FR_OK) res = sync_fs(fs);	/* Flush the FAT and FSInfo */
+	if (res == FR_OK) {
+		sect = clst2sect(fs, cl);
+		mem_set(fs->win, 0, SS(fs));	/* Create the snapshot */
+		st_dword(fs->win + FM_Sig, 0x50414D46);
+		fs->win[FM_Flag] = 1;
+		fs->win[FM_Csh] = fs->fm_csh;
+		st_dword(fs->win + FM_NumEnt, fs->n_fatent);
+		st_dword(fs->win + FM_FreeCnt, fs->free_clst);
+		st_dword(fs->win + FM_NxtFree, fs->last_clst);
+		mem_cpy(fs->win + FM_Map, fs->fmap, sizeof fs->fmap);
+		fs->winsect = sect;
+		if (disk_write(fs->pdrv, fs->win, sect, 1) != RES_OK || disk_ioctl(fs->pdrv, CTRL_SYNC, 0) != RES_OK) res = FR_DISK_ERR;
+	}
+	FREE_NAMBUF();
+	return res;
+}
+
+#endif
+
+
+
+
+#if !FF_FS_READONLY && FF_USE_DIRINDEX
+/*-----------------------------------------------------------------------*/
+/* Load the directory index                                              */
+/*-----------------------------------------------------------------------*/
+
+static void dix_load (
+	FATFS* fs		/* Filesystem object just mounted */
+)
+{
+	DIR dj;
+	DWORD cl, ncl, n, i;
+
+
+	fs->dx_stat = 2;					/* The index is not available by default */
+	fs->dx_sect = 0;
+	mem_set(fs->dx_map, 0, sizeof fs->dx_map);
+
+	/* Find the index file */
+	dj.obj.fs = fs;
+	dj.obj.sclust = 0;					/* Root directory */
+	mem_cpy(dj.fn, DX_NAME, 11);
+	dj.fn[NSFLAG] = NS_NOLFN;			/* Find only SFN */
+	switch (dir_find(&dj)) {
+	case FR_OK: break;
+	case FR_NO_FILE: fs->dx_stat = 0; return;	/* It is to be created at first use */
+	default: return;
+	}
+	cl = ld_clust(fs, dj.dir);
+	if (cl < 2 || cl >= fs->n_fatent || ld_dword(dj.dir + DIR_FileSize) != (1 + FF_USE_DIRINDEX) * SS(fs)) return;
+
+	/* Check if the index file is contiguous */
+	ncl = (1 + FF_USE_DIRINDEX + fs->csize - 1) / fs->csize;
+	for (i = 0; i < ncl; i++) {
+		n = get_fat(&dj.obj, cl + i);
+		if (n == 0xFFFFFFFF || (i + 1 < ncl ? n != cl + i + 1 : n < fs->n_fatent)) return;
+	}
+
+	/* Load the header */
+	fs->dx_sect = clst2sect(fs, cl);
+	if (fs->dx_sect == 0 || move_window(fs, fs->dx_sect) != FR_OK) return;
+	if (ld_dword(fs->win + DX_Sig) != 0x58444944 || ld_dword(fs->win + DX_NumSec) != FF_USE_DIRINDEX) return;	/* "DIDX" */
+	mem_cpy(fs->dx_map, fs->win + DX_Map, sizeof fs->dx_map);
+	fs->dx_stat = 1;
+}
+
+#endif
+
+
+
+
 /*-----------------------------------------------------------------------*/
 /* Load a sector and check if it is an FAT VBR                           */
 /*-----------------------------------------------------------------------*/
@@ -2843,6 +4178,9 @@ FRESULT find_volume (	/* FR_OK(0): successful, !=0: an error occurred */
 #if !FF_FS_READONLY
 	/* Get FSInfo if available */
 	fs->last_clst = fs->free_clst = 0xFFFFFFFF;		/* Initialize cluster allocation information */
+#if FF_ALLOC_ZONE
+	fs->zn_last[0] = fs->zn_last[1] = 0; fs->zn_full = 0;
+#endif
 	fs->fsi_flag = 0x80;
 #if (FF_FS_NOFSINFO & 3) != 3
 	if (fmt == FS_FAT32				/* Allow to update FSInfo only if BPB_FSInfo32 == 1 */
@@ -2869,11 +4207,30 @@ FRESULT find_volume (	/* FR_OK(0): successful, !=0: an error occurred */
 	fs->fs_type = fmt;		/* FAT sub-type */
 	fs->id = ++Fsid;		/* Volume mount ID */
 #if FF_USE_LFN == 1
-	fs->lfnbuf = LfnBuf;	/* Static LFN working buffer */
+	fs->lfnbuf = LFNBUF(fs);	/* Static LFN working buffer */
 #endif
 #if FF_FS_RPATH != 0
 	fs->cdir = 0;			/* Initialize current directory */
 #endif
+#if FF_FS_RPATH >= 2 && FF_CWD_CACHE
+	fs->cwdclst = 0;		/* Initialize cached path of current directory */
+	fs->cwdpath[0] = 0;
+#endif
+#if FF_FS_REENTRANT && FF_FS_MAXHOLD
+	fs->hop = 0;			/* Initialize volume hold statistics */
+	mem_set(fs->hmax, 0, sizeof fs->hmax);
+#endif
+#if !FF_FS_READONLY && FF_USE_TRIM && FF_TRIM_QUEUE
+	fs->tq_n = 0;			/* Initialize the trim queue */
+	mem_set(fs->tq_stat, 0, sizeof fs->tq_stat);
+	if (disk_ioctl(fs->pdrv, GET_BLOCK_SIZE, &fs->tq_gran) != RES_OK || !fs->tq_gran || fs->tq_gran > 32768 || (fs->tq_gran & (fs->tq_gran - 1))) fs->tq_gran = 1;
+#endif
+#if !FF_FS_READONLY && FF_USE_FREEMAP
+	fmap_load(fs);			/* Take the free cluster map left at last unmount */
+#endif
+#if !FF_FS_READONLY && FF_USE_DIRINDEX
+	dix_load(fs);			/* Find the directory index */
+#endif
 #if FF_FS_LOCK != 0			/* Clear file lock semaphores */
 	clear_lock(fs);
 #endif
@@ -2921,21 +4278,47 @@ static FRESULT validate (	/* Returns FR_OK or FR_INVALID_OBJECT */
 }
 
 
-static
-UINT get_clustinfo(FIL* fp,
-	DWORD* fclust
+
+static FRESULT find_base (	/* FR_OK(0): successful, !=0: an error occurred */
+	DIR* base,				/* Open directory a relative path starts from */
+	FATFS** rfs,			/* Pointer to pointer to the found filesystem object */
+	BYTE mode				/* !=0: Check write protection for write access */
+)
+{
+	FRESULT res;
+
+
+	res = validate(&base->obj, rfs);	/* Check validity of the directory object */
+#if FF_FS_REENTRANT && !defined(__LITEOS_M__)
+	if (res == FR_OK && !lock_fs(*rfs)) res = FR_TIMEOUT;	/* Lock the volume as find_volume() does */
+#endif
+	mode &= (BYTE)~FA_READ;
+	if (res == FR_OK && !FF_FS_READONLY && mode && (disk_status((*rfs)->pdrv) & STA_PROTECT)) {	/* Check write protection if needed */
+		res = FR_WRITE_PROTECTED;
+	}
+	return res;
+}
+
+
+static
+UINT get_clustinfo(FIL* fp,	/* Number of clusters in the chain (0xFFFFFFFF:broken chain or disk error) */
+	DWORD* fclust
 )
 {
 	UINT count = 0;
 	DWORD fsclust = 0, val;
+	CHWALK cw;
 
 	if (fp->obj.sclust != 0) {
 		val = fp->obj.sclust;
+		chain_init(&cw, fp->obj.fs, val);
 		do {
 			fsclust = val;
 			val = get_fat(&fp->obj, fsclust);
 			count++;
-		} while ((val != 0x0FFFFFFF) && (val != 1));
+			if (val < 2 || val == 0xFFFFFFFF) return 0xFFFFFFFF;
+			if (val < fp->obj.fs->n_fatent && chain_chk(&cw, val)) return 0xFFFFFFFF;
+		} while (val < fp->obj.fs->n_fatent);	/* Repeat while not the last link */
 	}
 	*fclust = fsclust;
 	return count;
@@ -2957,7 +4340,7 @@ UINT get_clustinfo(FIL* fp,
 FRESULT f_mount (
 	FATFS* fs,			/* Pointer to the filesystem object (NULL:unmount)*/
 	const TCHAR* path,	/* Logical drive number to be mounted/unmounted */
-	BYTE opt			/* Mode option 0:Do not mount (delayed mount), 1:Mount immediately */
+	BYTE opt			/* Mode option 0:Do not mount (delayed mount), 1:Mount immediately, +MT_NEAR:Near allocation */
 )
 {
 	FATFS *cfs;
@@ -2972,6 +4355,24 @@ FRESULT f_mount (
 	cfs = FatFs[vol];					/* Pointer to fs object */
 
 	if (cfs) {
+#if !FF_FS_READONLY && (FF_USE_FREEMAP || (FF_USE_TRIM && FF_TRIM_QUEUE))
+		if (cfs->fs_type) {				/* Write back the volume state under the volume lock (an error does not fail the unmount) */
+#if FF_FS_REENTRANT
+			if (lock_fs(cfs))
+#endif
+			{
+#if FF_USE_FREEMAP
+				fmap_save(cfs);			/* Leave the free cluster map for next mount */
+#endif
+#if FF_USE_TRIM && FF_TRIM_QUEUE
+				trim_flush(cfs);		/* Trim the blocks left in the queue */
+#endif
+#if FF_FS_REENTRANT
+				unlock_fs(cfs, FR_OK);
+#endif
+			}
+		}
+#endif
 #if FF_FS_LOCK != 0
 		clear_lock(cfs);
 #endif
@@ -2989,18 +4390,157 @@ FRESULT f_mount (
 		fs->vir_amount = 0xFFFFFFFF;
 		fs->vir_avail = FS_VIRDISABLE;
 #endif
+#if FF_FS_LOCK != 0 && FF_VOL_LOCAL
+		mem_set(fs->files, 0, sizeof fs->files);	/* Clear lock table of the new volume */
+#endif
 #if FF_FS_REENTRANT						/* Create sync object for the new volume */
 		if (!ff_cre_syncobj((BYTE)vol, &fs->sobj)) return FR_INT_ERR;
+#if FF_FS_MAXHOLD
+		fs->hdepth = 0;
+#endif
+#endif
+#if !FF_FS_READONLY && FF_ALLOC_NEAR
+		fs->alloc_near = (opt & MT_NEAR) ? 1 : 0;	/* Allocation policy of the volume */
 #endif
 	}
 	FatFs[vol] = fs;					/* Register new fs object */
 
-	if (opt == 0) return FR_OK;			/* Do not mount now, it will be mounted later */
+	if ((opt & 1) == 0) return FR_OK;	/* Do not mount now, it will be mounted later */
 
 	res = find_volume(&path, &fs, 0);	/* Force mounted the volume */
 	LEAVE_FF(fs, res);
 }
 
+#if FF_USE_WARMUP && !defined(__LITEOS_M__)
+/*-----------------------------------------------------------------------*/
+/* Warm Up the Volume                                                    */
+/*-----------------------------------------------------------------------*/
+/* The FAT and directory sectors the first accesses will need are read   */
+/* in large blocks, so that the block cache under the disk functions     */
+/* holds them. The window is left at the top of the root directory.      */
+
+static FRESULT warm_read (	/* FR_OK(0):succeeded, !=0:error */
+	FATFS* fs,			/* Filesystem object */
+	BYTE* buf,			/* Scratch buffer */
+	UINT szb,			/* Size of the scratch buffer [sectors] */
+	QWORD sect,			/* Start sector */
+	DWORD nsc			/* Number of sectors to read */
+)
+{
+	UINT cc;
+
+
+	for ( ; nsc; nsc -= cc, sect += cc) {
+		cc = (nsc < szb) ? (UINT)nsc : szb;
+		if (disk_read(fs->pdrv, buf, sect, cc) != RES_OK) return FR_DISK_ERR;
+	}
+	return FR_OK;
+}
+
+
+static FRESULT warm_dir (	/* FR_OK(0):succeeded, !=0:error */
+	FATFS* fs,			/* Filesystem object */
+	BYTE* buf,			/* Scratch buffer */
+	UINT szb,			/* Size of the scratch buffer [sectors] */
+	DWORD clst			/* Start cluster of the directory (0:root directory) */
+)
+{
+	FRESULT res;
+	FFOBJID obj;
+	DWORD scl, ncl, nxt, lim;
+
+
+	if (clst == 0) {
+		if (fs->fs_type != FS_FAT32) {	/* Static root directory */
+			return warm_read(fs, buf, szb, fs->dirbase, (DWORD)fs->n_rootdir * SZDIRE / SS(fs));
+		}
+		clst = (DWORD)fs->dirbase;
+	}
+	if (clst < 2 || clst >= fs->n_fatent) return FR_INT_ERR;
+
+	/* Read each fragment of the directory table at a time */
+	obj.fs = fs;
+	scl = clst; ncl = 1;
+	for (lim = fs->n_fatent; lim; lim--) {
+		nxt = get_fat(&obj, clst);
+		if (nxt == 1) return FR_INT_ERR;
+		if (nxt == 0xFFFFFFFF) return FR_DISK_ERR;
+		if (nxt == clst + 1) {			/* Contiguous */
+			clst = nxt; ncl++;
+			continue;
+		}
+		res = warm_read(fs, buf, szb, clst2sect(fs, scl), ncl * fs->csize);
+		if (res != FR_OK || nxt < 2 || nxt >= fs->n_fatent) return res;	/* End of the chain? */
+		scl = clst = nxt; ncl = 1;
+	}
+	return FR_INT_ERR;	/* Circular chain */
+}
+
+
+FRESULT f_warmup (
+	const TCHAR* path,			/* Logical drive number */
+	const TCHAR* const* dirs,	/* Hot directories on the volume to be read (NULL:none) */
+	UINT ndir					/* Number of items in dirs[] */
+)
+{
+	FRESULT res;
+	FATFS *fs;
+	DIR dj;
+	BYTE *buf;
+	UINT szb, i;
+	QWORD sect;
+	DWORD n;
+	DEF_NAMBUF
+
+
+	res = find_volume(&path, &fs, 0);	/* Get logical drive */
+	if (res == FR_OK) {
+		INIT_NAMBUF(fs);
+		for (szb = MAX_MALLOC, buf = 0; szb >= SS(fs) && (buf = ff_memalloc(szb)) == 0; szb /= 2) ;
+		if (!buf) res = FR_NOT_ENOUGH_CORE;
+		szb /= SS(fs);		/* Bytes -> Sectors */
+
+		if (res == FR_OK) {		/* Head of the FAT */
+			n = (fs->fsize < FF_WARMUP_FAT) ? fs->fsize : FF_WARMUP_FAT;
+			res = warm_read(fs, buf, szb, fs->fatbase, n);
+		}
+#if !FF_FS_READONLY
+		if (res == FR_OK && fs->last_clst >= 2 && fs->last_clst < fs->n_fatent) {	/* FAT around the free cluster hint */
+			switch (fs->fs_type) {
+			case FS_FAT12 :	sect = fs->last_clst + fs->last_clst / 2; break;
+			case FS_FAT16 :	sect = fs->last_clst * 2; break;
+			default :		sect = fs->last_clst * 4; break;
+			}
+			sect = fs->fatbase + sect / SS(fs);
+			if (sect < fs->fatbase + n) sect = fs->fatbase + n;		/* Skip the sectors already read */
+			if (sect < fs->fatbase + fs->fsize) {
+				n = (DWORD)(fs->fatbase + fs->fsize - sect);
+				if (n > FF_WARMUP_FAT) n = FF_WARMUP_FAT;
+				res = warm_read(fs, buf, szb, sect, n);
+			}
+		}
+#endif
+		if (res == FR_OK) res = warm_dir(fs, buf, szb, 0);	/* Root directory */
+		dj.obj.fs = fs;
+		for (i = 0; res == FR_OK && dirs && i < ndir; i++) {	/* Hot directories */
+			res = follow_path(&dj, dirs[i]);
+			if (res == FR_OK && !(dj.fn[NSFLAG] & NS_NONAME)) {
+				res = (dj.obj.attr & AM_DIR) ? warm_dir(fs, buf, szb, ld_clust(fs, dj.dir)) : FR_NO_PATH;
+			}
+			if (res == FR_NO_FILE || res == FR_NO_PATH) res = FR_OK;	/* Skip the directory not found */
+		}
+		if (buf) ff_memfree(buf);
+
+		if (res == FR_OK) {		/* Leave the window at the root directory */
+			res = move_window(fs, (fs->fs_type == FS_FAT32) ? clst2sect(fs, (DWORD)fs->dirbase) : fs->dirbase);
+		}
+		FREE_NAMBUF();
+	}
+
+	LEAVE_FF(fs, res);
+}
+#endif	/* FF_USE_WARMUP && !__LITEOS_M__ */
+
 #ifndef __LITEOS_M__
 FRESULT init_fatobj(FATFS *fs, BYTE fmt, QWORD start_sector)
 {
@@ -3070,6 +4610,9 @@ FRESULT init_fatobj(FATFS *fs, BYTE fmt, QWORD start_sector)
 #if !FF_FS_READONLY
 	/* Get FSInfo if available */
 	fs->last_clst = fs->free_clst = DISK_ERROR; /* Initialize cluster allocation information */
+#if FF_ALLOC_ZONE
+	fs->zn_last[0] = fs->zn_last[1] = 0; fs->zn_full = 0;
+#endif
 	fs->fsi_flag = 0x80;
 #if (FF_FS_NOFSINFO & 3) != 3
 	if (fmt == FS_FAT32 /* Allow to update FSInfo only if BPB_FSInfo32 == 1 */
@@ -3093,10 +4636,29 @@ FRESULT init_fatobj(FATFS *fs, BYTE fmt, QWORD start_sector)
 	fs->fs_type = fmt;		/* FAT sub-type */
 	fs->id = 0;		/* Volume mount ID */
 #if FF_USE_LFN == 1
-	fs->lfnbuf = LfnBuf;	/* Static LFN working buffer */
+	fs->lfnbuf = LFNBUF(fs);	/* Static LFN working buffer */
 #endif
 #if FF_FS_RPATH != 0
 	fs->cdir = 0;			/* Initialize current directory */
+#endif
+#if FF_FS_RPATH >= 2 && FF_CWD_CACHE
+	fs->cwdclst = 0;		/* Initialize cached path of current directory */
+	fs->cwdpath[0] = 0;
+#endif
+#if FF_FS_REENTRANT && FF_FS_MAXHOLD
+	fs->hop = 0;			/* Initialize volume hold statistics */
+	mem_set(fs->hmax, 0, sizeof fs->hmax);
+#endif
+#if !FF_FS_READONLY && FF_USE_TRIM && FF_TRIM_QUEUE
+	fs->tq_n = 0;			/* Initialize the trim queue */
+	mem_set(fs->tq_stat, 0, sizeof fs->tq_stat);
+	if (disk_ioctl(fs->pdrv, GET_BLOCK_SIZE, &fs->tq_gran) != RES_OK || !fs->tq_gran || fs->tq_gran > 32768 || (fs->tq_gran & (fs->tq_gran - 1))) fs->tq_gran = 1;
+#endif
+#if !FF_FS_READONLY && FF_USE_FREEMAP
+	fmap_load(fs);			/* Take the free cluster map left at last unmount */
+#endif
+#if !FF_FS_READONLY && FF_USE_DIRINDEX
+	dix_load(fs);			/* Find the directory index */
 #endif
 	return FR_OK;
 }
@@ -3168,8 +4730,9 @@ FRESULT find_fat_partition(FATFS *fs, los_part *part, BYTE *format, QWORD *start
 /* Open or Create a File                                                 */
 /*-----------------------------------------------------------------------*/
 
-FRESULT f_open (
+static FRESULT open_at (
 	FIL* fp,			/* Pointer to the blank file object */
+	DIR* base,			/* Directory the file name is relative to (NULL:path with drive prefix) */
 	const TCHAR* path,	/* Pointer to the file name */
 	BYTE mode			/* Access mode and file open mode flags */
 )
@@ -3184,15 +4747,24 @@ FRESULT f_open (
 	DWORD clst, cl, bcs;
 	QWORD sc, dw;
 	FSIZE_t ofs;
+#endif
+#if !FF_FS_READONLY && FF_USE_STREAM
+	BYTE stm;
+#endif
+#ifdef LOSCFG_FS_FAT_VIRTUAL_PARTITION
+	CHWALK cw;
 #endif
 	DEF_NAMBUF
 
 
 	if (!fp) return FR_INVALID_OBJECT;
 
+#if !FF_FS_READONLY && FF_USE_STREAM
+	stm = ((mode & (FA_STREAM | FA_WRITE)) == (FA_STREAM | FA_WRITE)) ? 1 : 0;	/* Streaming mode is for write access only */
+#endif
 	/* Get logical drive number */
 	mode &= FF_FS_READONLY ? FA_READ : FA_READ | FA_WRITE | FA_CREATE_ALWAYS | FA_CREATE_NEW | FA_OPEN_ALWAYS | FA_OPEN_APPEND | FA_SEEKEND;
-	res = find_volume(&path, &fs, mode);
+	res = base ? find_base(base, &fs, mode) : find_volume(&path, &fs, mode);
 #if FF_FS_REENTRANT
 	fs_bak = fs;
 #endif
@@ -3200,11 +4772,11 @@ FRESULT f_open (
 		dj.obj.fs = fs;
 #ifdef LOSCFG_FS_FAT_VIRTUAL_PARTITION
 #if FF_FS_REENTRANT
-		if (ISCHILD(fs)) LEAVE_FF(fs_bak,FR_INVAILD_FATFS);
+		if (!base && ISCHILD(fs)) LEAVE_FF(fs_bak,FR_INVAILD_FATFS);
 #else
-		if (ISCHILD(fs)) LEAVE_FF(fs,FR_INVAILD_FATFS);
+		if (!base && ISCHILD(fs)) LEAVE_FF(fs,FR_INVAILD_FATFS);
 #endif
-		if (ISVIRPART(fs)) {
+		if (!base && ISVIRPART(fs)) {	/* (A base directory is already in the virtual partition) */
 			/* Check the virtual partition top directory, and match the virtual fs */
 			res = follow_virentry(&dj.obj,path);
 #if FF_FS_REENTRANT
@@ -3217,7 +4789,7 @@ FRESULT f_open (
 			}
 #endif
 		INIT_NAMBUF(fs);
-		res = follow_path(&dj, path);	/* Follow the file path */
+		res = follow_path_at(&dj, base, path);	/* Follow the file path */
 #if !FF_FS_READONLY	/* Read/Write configuration */
 		if (res == FR_OK) {
 			if (dj.fn[NSFLAG] & NS_NONAME) {	/* Origin directory itself? */
@@ -3235,7 +4807,7 @@ FRESULT f_open (
 			if (res != FR_OK) {					/* No file, create new */
 				if ((res == FR_NO_FILE) && (mode & FA_OPEN_ALWAYS)) {		/* There is no file to open, create a new entry */
 #if FF_FS_LOCK != 0
-					res = enq_lock() ? dir_register(&dj) : FR_TOO_MANY_OPEN_FILES;
+					res = enq_lock(dj.obj.fs) ? dir_register(&dj) : FR_TOO_MANY_OPEN_FILES;
 #else
 					res = dir_register(&dj);
 #endif
@@ -3339,6 +4911,15 @@ FRESULT f_open (
 			fp->obj.id = fs->id;
 			fp->flag = mode;		/* Set file access mode */
 			fp->err = 0;			/* Clear error flag */
+#if FF_USE_FILESTAT
+			mem_set(&fp->fst, 0, sizeof (FFFSTAT));	/* Clear I/O counters */
+			fp->fst.dir = dj.obj.sclust;
+#endif
+#if !FF_FS_READONLY && FF_USE_STREAM
+			fp->st_mode = stm;		/* Set streaming mode */
+			fp->st_size = fp->obj.objsize;
+			fp->st_time = stream_sec(GET_FATTIME());
+#endif
 			fp->sect = 0;			/* Invalidate current data sector */
 			fp->fptr = 0;			/* Set file pointer top of the file */
 #if !FF_FS_READONLY
@@ -3350,10 +4931,12 @@ FRESULT f_open (
 				fp->fptr = fp->obj.objsize;			/* Offset to seek */
 				bcs = (DWORD)fs->csize * SS(fs);	/* Cluster size in byte */
 				clst = fp->obj.sclust;				/* Follow the cluster chain */
-				for (ofs = fp->obj.objsize; res == FR_OK && ofs > bcs; ofs -= bcs) {
+				for (ofs = fp->obj.objsize; res == FR_OK && ofs > bcs; ofs -= bcs) {	/* The walk is bounded by the file size */
 					clst = get_fat(&fp->obj, clst);
+					FST_ADD(fp, fat_get, 1);
 					if (clst <= 1) res = FR_INT_ERR;
 					if (clst == 0xFFFFFFFF) res = FR_DISK_ERR;
+					else if (clst >= fs->n_fatent) res = FR_INT_ERR;	/* Chain is shorter than the file size */
 				}
 				fp->clust = clst;
 				if (res == FR_OK && ofs % SS(fs)) {	/* Fill sector buffer if not on the sector boundary */
@@ -3362,7 +4945,9 @@ FRESULT f_open (
 					} else {
 						fp->sect = sc + (DWORD)(ofs / SS(fs));
 #if !FF_FS_TINY
-						if (disk_read(fs->pdrv, fp->buf, fp->sect, 1) != RES_OK) res = FR_DISK_ERR;
+						FST_ADD(fp, dat_read, 1);
+						FST_ADD(fp, buf_fill, 1);
+						if (FST_IO(fp, disk_read(fs->pdrv, fp->buf, fp->sect, 1)) != RES_OK) res = FR_DISK_ERR;
 #endif
 					}
 				}
@@ -3377,6 +4962,7 @@ FRESULT f_open (
 		    (ISCHILD(fs) || (ISPARENT(fs) && fs->st_clst != 0xFFFFFFFF && fs->ct_clst != 0xFFFFFFFF))) {
 			clst = fp->obj.sclust;
 			if (clst != 0) {
+				chain_init(&cw, fs, clst);
 				while (1) {
 					if (clst == 0xFFFFFFFF) {
 						res = FR_DISK_ERR;
@@ -3395,12 +4981,16 @@ FRESULT f_open (
 						break;
 					}
 					clst = get_fat(&fp->obj, clst);
+					if (clst >= 2 && clst < fs->n_fatent && chain_chk(&cw, clst)) {
+						res = FR_INT_ERR;
+						break;
+					}
 				}
 			}
 
 			if (res != FR_OK) {
 				/* If the chain is occupied, Recycle the file lock ,pass out an error*/
-				dec_lock(fp->obj.lockid);
+				dec_lock(fs, fp->obj.lockid);
 			}
 		}
 #endif
@@ -3416,6 +5006,30 @@ FRESULT f_open (
 }
 
 
+FRESULT f_open (
+	FIL* fp,			/* Pointer to the blank file object */
+	const TCHAR* path,	/* Pointer to the file name */
+	BYTE mode			/* Access mode and file open mode flags */
+)
+{
+	return open_at(fp, 0, path, mode);
+}
+
+
+#if FF_USE_OPENAT
+FRESULT f_open_at (
+	FIL* fp,			/* Pointer to the blank file object */
+	DIR* dp,			/* Pointer to the open directory the name is relative to */
+	const TCHAR* name,	/* Pointer to the file name */
+	BYTE mode			/* Access mode and file open mode flags */
+)
+{
+	if (!dp) return FR_INVALID_OBJECT;
+	return open_at(fp, dp, name, mode);
+}
+#endif
+
+
 
 
 /*-----------------------------------------------------------------------*/
@@ -3462,6 +5076,7 @@ FRESULT f_read (
 #endif
 					{
 						clst = get_fat(&fp->obj, fp->clust);	/* Follow cluster chain on the FAT */
+						FST_ADD(fp, fat_get, 1);
 					}
 				}
 				if (clst < 2) ABORT(fs, FR_INT_ERR);
@@ -3476,7 +5091,8 @@ FRESULT f_read (
 				if (csect + cc > fs->csize) {	/* Clip at cluster boundary */
 					cc = fs->csize - csect;
 				}
-				if (disk_read(fs->pdrv, rbuff, sect, cc) != RES_OK) ABORT(fs, FR_DISK_ERR);
+				FST_ADD(fp, dat_read, cc);
+				if (FST_IO(fp, disk_read(fs->pdrv, rbuff, sect, cc)) != RES_OK) ABORT(fs, FR_DISK_ERR);
 #if !FF_FS_READONLY && FF_FS_MINIMIZE <= 2		/* Replace one of the read sectors with cached data if it contains a dirty sector */
 #if FF_FS_TINY
 				if (fs->wflag && fs->winsect - sect < cc) {
@@ -3505,17 +5121,21 @@ FRESULT f_read (
 			if (fp->sect != sect) {			/* Load data sector if not in cache */
 #if !FF_FS_READONLY
 				if (fp->flag & FA_DIRTY) {		/* Write-back dirty sector cache */
-					if (disk_write(fs->pdrv, fp->buf, fp->sect, 1) != RES_OK) ABORT(fs, FR_DISK_ERR);
+					FST_ADD(fp, dat_write, 1);
+					if (FST_IO(fp, disk_write(fs->pdrv, fp->buf, fp->sect, 1)) != RES_OK) ABORT(fs, FR_DISK_ERR);
 					fp->flag &= (BYTE)~FA_DIRTY;
 				}
 #endif
-				if (disk_read(fs->pdrv, fp->buf, sect, 1) != RES_OK)	ABORT(fs, FR_DISK_ERR);	/* Fill sector cache */
+				FST_ADD(fp, dat_read, 1);
+				FST_ADD(fp, buf_fill, 1);
+				if (FST_IO(fp, disk_read(fs->pdrv, fp->buf, sect, 1)) != RES_OK)	ABORT(fs, FR_DISK_ERR);	/* Fill sector cache */
 			}
 #endif
 			fp->sect = sect;
 		}
 		rcnt = SS(fs) - (UINT)fp->fptr % SS(fs);	/* Number of bytes left in the sector */
 		if (rcnt > btr) rcnt = btr;					/* Clip it by btr if needed */
+		FST_ADD(fp, part_acc, 1);
 #if FF_FS_TINY
 		if (move_window(fs, fp->sect) != FR_OK) ABORT(fs, FR_DISK_ERR);	/* Move sector window */
 
@@ -3532,6 +5152,7 @@ FRESULT f_read (
 #endif
 	}
 
+	FST_ADD(fp, rd_bytes, *br);
 	LEAVE_FF(fs, FR_OK);
 }
 
@@ -3561,6 +5182,9 @@ FRESULT f_write (
 	res = validate(&fp->obj, &fs);			/* Check validity of the file object */
 	if (res != FR_OK || (res = (FRESULT)fp->err) != FR_OK) LEAVE_FF(fs, res);	/* Check validity */
 	if (!(fp->flag & FA_WRITE)) LEAVE_FF(fs, FR_NO_EPERM);	/* Check access mode */
+#if FF_USE_STREAM
+	if (fp->st_mode && fp->fptr != fp->obj.objsize) LEAVE_FF(fs, FR_DENIED);	/* Stream is append-only */
+#endif
 
 	/* Check fptr wrap-around (file size cannot reach 4 GiB at FAT volume) */
 	if ((DWORD)(fp->fptr + btw) < (DWORD)fp->fptr) {
@@ -3575,6 +5199,12 @@ FRESULT f_write (
 				if (fp->fptr == 0) {		/* On the top of the file? */
 					clst = fp->obj.sclust;	/* Follow from the origin */
 					if (clst == 0) {		/* If no cluster is allocated, */
+#if FF_ALLOC_NEAR
+						alloc_near(fs, fp->dir_sect);
+#endif
+#if FF_ALLOC_ZONE
+						alloc_zone(fp, fp->fptr + btw);
+#endif
 						clst = create_chain(&fp->obj, 0);	/* create a new cluster chain */
 					}
 				} else {					/* On the middle or end of the file */
@@ -3584,6 +5214,9 @@ FRESULT f_write (
 					} else
 #endif
 					{
+#if FF_ALLOC_ZONE
+						if (fp->fptr >= fp->obj.objsize) alloc_zone(fp, fp->fptr + btw);
+#endif
 						clst = create_chain(&fp->obj, fp->clust);	/* Follow or stretch cluster chain on the FAT */
 					}
 				}
@@ -3592,12 +5225,26 @@ FRESULT f_write (
 				if (clst == 0xFFFFFFFF) ABORT(fs, FR_DISK_ERR);
 				fp->clust = clst;			/* Update current cluster */
 				if (fp->obj.sclust == 0) fp->obj.sclust = clst;	/* Set start cluster if the first write */
+#if FF_USE_FILESTAT
+				if (fp->fptr >= fp->obj.objsize) {	/* The cluster is taken beyond the file size */
+					fp->fst.clst_alloc++;
+				} else if (fp->fptr != 0) {
+					fp->fst.fat_get++;
+				}
+#endif
+#if FF_USE_STREAM
+				if (fp->st_mode) {			/* Preallocate clusters ahead if the chain ends here */
+					res = stream_ahead(fp, clst);
+					if (res != FR_OK) ABORT(fs, res);
+				}
+#endif
 			}
 #if FF_FS_TINY
 			if (fs->winsect == fp->sect && sync_window(fs) != FR_OK) ABORT(fs, FR_DISK_ERR);	/* Write-back sector cache */
 #else
 			if (fp->flag & FA_DIRTY) {		/* Write-back sector cache */
-				if (disk_write(fs->pdrv, fp->buf, fp->sect, 1) != RES_OK) ABORT(fs, FR_DISK_ERR);
+				FST_ADD(fp, dat_write, 1);
+				if (FST_IO(fp, disk_write(fs->pdrv, fp->buf, fp->sect, 1)) != RES_OK) ABORT(fs, FR_DISK_ERR);
 				fp->flag &= (BYTE)~FA_DIRTY;
 			}
 #endif
@@ -3607,9 +5254,15 @@ FRESULT f_write (
 			cc = btw / SS(fs);				/* When remaining bytes >= sector size, */
 			if (cc > 0) {					/* Write maximum contiguous sectors directly */
 				if (csect + cc > fs->csize) {	/* Clip at cluster boundary */
+#if FF_USE_STREAM
+					if (fp->st_mode) {		/* Stream goes over contiguous clusters */
+						cc = stream_span(fp, csect, cc);
+					} else
+#endif
 					cc = fs->csize - csect;
 				}
-				if (disk_write(fs->pdrv, wbuff, sect, cc) != RES_OK) ABORT(fs, FR_DISK_ERR);
+				FST_ADD(fp, dat_write, cc);
+				if (FST_IO(fp, disk_write(fs->pdrv, wbuff, sect, cc)) != RES_OK) ABORT(fs, FR_DISK_ERR);
 #if FF_FS_MINIMIZE <= 2
 #if FF_FS_TINY
 				if (fs->winsect - sect < cc) {	/* Refill sector cache if it gets invalidated by the direct write */
@@ -3638,16 +5291,17 @@ FRESULT f_write (
 				fs->winsect = sect;
 			}
 #else
-			if (fp->sect != sect && 		/* Fill sector cache with file data */
-				fp->fptr < fp->obj.objsize &&
-				disk_read(fs->pdrv, fp->buf, sect, 1) != RES_OK) {
-					ABORT(fs, FR_DISK_ERR);
+			if (fp->sect != sect && fp->fptr < fp->obj.objsize) {	/* Fill sector cache with file data */
+				FST_ADD(fp, dat_read, 1);
+				FST_ADD(fp, buf_fill, 1);
+				if (FST_IO(fp, disk_read(fs->pdrv, fp->buf, sect, 1)) != RES_OK) ABORT(fs, FR_DISK_ERR);
 			}
 #endif
 			fp->sect = sect;
 		}
 		wcnt = SS(fs) - (UINT)fp->fptr % SS(fs);	/* Number of bytes left in the sector */
 		if (wcnt > btw) wcnt = btw;					/* Clip it by btw if needed */
+		FST_ADD(fp, part_acc, 1);
 #if FF_FS_TINY
 		if (move_window(fs, fp->sect) != FR_OK) ABORT(fs, FR_DISK_ERR);	/* Move sector window */
 
@@ -3667,6 +5321,7 @@ FRESULT f_write (
 	}
 
 	fp->flag |= FA_MODIFIED;				/* Set file change flag */
+	FST_ADD(fp, wr_bytes, *bw);
 
 	LEAVE_FF(fs, FR_OK);
 }
@@ -3690,12 +5345,26 @@ FRESULT f_sync (
 		if (fp->flag & FA_MODIFIED) {	/* Is there any change to the file? */
 #if !FF_FS_TINY
 			if (fp->flag & FA_DIRTY) {	/* Write-back cached data if needed */
-				if (disk_write(fs->pdrv, fp->buf, fp->sect, 1) != RES_OK) LEAVE_FF(fs, FR_DISK_ERR);
+				FST_ADD(fp, dat_write, 1);
+				if (FST_IO(fp, disk_write(fs->pdrv, fp->buf, fp->sect, 1)) != RES_OK) LEAVE_FF(fs, FR_DISK_ERR);
 				fp->flag &= (BYTE)~FA_DIRTY;
 			}
 #endif
 			/* Update the directory entry */
 			tm = GET_FATTIME();		/* Modified time */
+#if FF_USE_STREAM
+			if (fp->st_mode == 1 && fp->st_size != 0 && fp->obj.objsize >= fp->st_size	/* Is the directory entry update not due yet? */
+				&& fp->obj.objsize - fp->st_size < FF_STREAM_SYNC
+				&& (FF_STREAM_TIME == 0 || stream_sec(tm) - fp->st_time < FF_STREAM_TIME)) {
+				res = sync_window(fs);		/* Flush the FAT only */
+				if (res == FR_OK && disk_ioctl(fs->pdrv, CTRL_SYNC, 0) != RES_OK) res = FR_DISK_ERR;
+				LEAVE_FF(fs, res);
+			}
+			if (fp->st_mode == 2) {		/* Release the preallocated clusters on close */
+				res = stream_trim(fp);
+				if (res != FR_OK) LEAVE_FF(fs, res);
+			}
+#endif
 
 			res = move_window(fs, fp->dir_sect);
 
@@ -3717,6 +5386,14 @@ FRESULT f_sync (
 #endif
 
 				res = sync_fs(fs);					/* Restore it to the directory */
+#if FF_USE_TRIM && FF_TRIM_QUEUE
+				if (res == FR_OK) trim_flush(fs);	/* Trim the blocks freed so far */
+#endif
+#if FF_USE_STREAM
+				fp->st_size = fp->obj.objsize;
+				fp->st_time = stream_sec(tm);
+				if (fp->st_mode == 1) LEAVE_FF(fs, res);	/* Keep the file modified to be trimmed on close */
+#endif
 				fp->flag &= (BYTE)~FA_MODIFIED;
 			}
 		}
@@ -3742,14 +5419,20 @@ FRESULT f_close (
 	FATFS *fs;
 
 #if !FF_FS_READONLY
+#if FF_USE_STREAM
+	if (fp && fp->st_mode) fp->st_mode = 2;	/* Force the directory entry update */
+#endif
 	res = f_sync(fp);					/* Flush cached data */
 	if (res == FR_OK || res == FR_DISK_ERR)
 #endif
 	{
 		res = validate(&fp->obj, &fs);	/* Lock volume */
 		if (res == FR_OK) {
+#if FF_USE_FILESTAT == 2
+			ff_filestat(fs, &fp->fst);	/* Pass the I/O counters to the application */
+#endif
 #if FF_FS_LOCK != 0
-			res = dec_lock(fp->obj.lockid);		/* Decrement file open counter */
+			res = dec_lock(fs, fp->obj.lockid);		/* Decrement file open counter */
 			if (res == FR_OK) fp->obj.fs = 0;	/* Invalidate file object */
 #else
 			fp->obj.fs = 0;	/* Invalidate file object */
@@ -3787,6 +5470,50 @@ FRESULT f_chdrive (
 
 
 
+#if FF_FS_RPATH >= 2 && FF_CWD_CACHE
+static void update_cwd (
+	DIR* dp,			/* Directory object pointing the new current directory */
+	const TCHAR* path,	/* Pointer to the path given to f_chdir() */
+	DWORD ocdir			/* Previous current directory */
+)
+{
+	FATFS *fs = dp->obj.fs;
+	TCHAR *cp = fs->cwdpath;
+	UINT i, n;
+	FILINFO fno;
+
+
+	if (*path == '/' || *path == '\\') {	/* Absolute path starts at the root directory */
+		while (*path == '/' || *path == '\\') path++;
+		cp[0] = 0;
+	} else {
+		if (fs->cwdclst != ocdir) {			/* Relative path needs the valid base path */
+			fs->cwdclst = 0xFFFFFFFF; return;
+		}
+	}
+	for (n = 0; path[n] && path[n] != '/' && path[n] != '\\'; n++) ;	/* Get length of the segment */
+	for (i = n; path[i] == '/' || path[i] == '\\'; i++) ;
+	if (path[i]) {							/* Two or more segments are left to f_getcwd() */
+		fs->cwdclst = 0xFFFFFFFF; return;
+	}
+	for (i = 0; cp[i]; i++) ;				/* Length of the base path */
+	if (n == 2 && path[0] == '.' && path[1] == '.') {	/* Parent directory */
+		while (i && cp[--i] != '/') ;
+		cp[i] = 0;
+	} else if (n > 0 && !(n == 1 && path[0] == '.')) {	/* Sub-directory */
+		get_fileinfo(dp, &fno);				/* Get the name as stored in the directory */
+		for (n = 0; fno.fname[n]; n++) ;
+		if (i + n + 2 > FF_CWD_CACHE) {		/* Does not fit in the buffer */
+			fs->cwdclst = 0xFFFFFFFF; return;
+		}
+		cp[i++] = '/';
+		mem_cpy(cp + i, fno.fname, (n + 1) * sizeof (TCHAR));
+	}
+	fs->cwdclst = fs->cdir;
+}
+#endif
+
+
 FRESULT f_chdir (
 	const TCHAR* path	/* Pointer to the directory path */
 )
@@ -3797,6 +5524,9 @@ FRESULT f_chdir (
 	FRESULT res;
 	DIR dj;
 	FATFS *fs;
+#if FF_FS_RPATH >= 2 && FF_CWD_CACHE
+	DWORD ocdir;
+#endif
 	DEF_NAMBUF
 
 
@@ -3805,6 +5535,9 @@ FRESULT f_chdir (
 	if (res == FR_OK) {
 		dj.obj.fs = fs;
 		INIT_NAMBUF(fs);
+#if FF_FS_RPATH >= 2 && FF_CWD_CACHE
+		ocdir = fs->cdir;
+#endif
 		res = follow_path(&dj, path);		/* Follow the path */
 		if (res == FR_OK) {					/* Follow completed */
 			if (dj.fn[NSFLAG] & NS_NONAME) {
@@ -3817,6 +5550,9 @@ FRESULT f_chdir (
 				}
 			}
 		}
+#if FF_FS_RPATH >= 2 && FF_CWD_CACHE
+		if (res == FR_OK) update_cwd(&dj, path, ocdir);	/* Update the cached path of current directory */
+#endif
 		FREE_NAMBUF();
 		if (res == FR_NO_FILE) res = FR_NO_PATH;
 #if FF_STR_VOLUME_ID == 2	/* Also current drive is changed at Unix style volume ID */
@@ -3864,6 +5600,17 @@ FRESULT f_getcwd (
 		i = len;			/* Bottom of buffer (directory stack base) */
 
 		dj.obj.sclust = fs->cdir;		/* Start to follow upper directory from current directory */
+#if FF_CWD_CACHE
+		if (fs->cwdclst == fs->cdir) {	/* Is the cached path valid? */
+			for (n = 0; fs->cwdpath[n]; n++) ;
+			if (i < n) {
+				res = FR_NOT_ENOUGH_CORE;
+			} else {
+				while (n) buff[--i] = fs->cwdpath[--n];
+			}
+			dj.obj.sclust = 0;			/* No need to follow the parent directories */
+		}
+#endif
 		while ((ccl = dj.obj.sclust) != 0) {	/* Repeat while current directory is a sub-directory */
 			res = dir_sdi(&dj, 1 * SZDIRE);	/* Get parent directory */
 			if (res != FR_OK) break;
@@ -3888,6 +5635,13 @@ FRESULT f_getcwd (
 			while (n) buff[--i] = fno.fname[--n];
 			buff[--i] = '/';
 		}
+#if FF_CWD_CACHE
+		if (res == FR_OK && fs->cwdclst != fs->cdir && len - i < FF_CWD_CACHE) {	/* Cache the path if it fits */
+			mem_cpy(fs->cwdpath, buff + i, (len - i) * sizeof (TCHAR));
+			fs->cwdpath[len - i] = 0;
+			fs->cwdclst = fs->cdir;
+		}
+#endif
 		if (res == FR_OK) {
 			if (i == len) buff[--i] = '/';	/* Is it the root-directory? */
 #if FF_VOLUMES >= 2			/* Put drive prefix */
@@ -3944,6 +5698,7 @@ FRESULT f_lseek (
 #if FF_USE_FASTSEEK
 	DWORD cl, pcl, ncl, tcl, tlen, ulen, *tbl;
 	QWORD dsc;
+	CHWALK cw;
 #endif
 
 	res = validate(&fp->obj, &fs);		/* Check validity of the file object */
@@ -3957,6 +5712,7 @@ FRESULT f_lseek (
 			tlen = *tbl++; ulen = 2;	/* Given table size and required table size */
 			cl = fp->obj.sclust;		/* Origin of the chain */
 			if (cl != 0) {
+				chain_init(&cw, fs, cl);
 				do {
 					/* Get a fragment */
 					tcl = cl; ncl = 0; ulen += 2;	/* Top, length and used items */
@@ -3965,6 +5721,7 @@ FRESULT f_lseek (
 						cl = get_fat(&fp->obj, cl);
 						if (cl <= 1) ABORT(fs, FR_INT_ERR);
 						if (cl == 0xFFFFFFFF) ABORT(fs, FR_DISK_ERR);
+						if (cl < fs->n_fatent && chain_chk(&cw, cl)) ABORT(fs, FR_INT_ERR);
 					} while (cl == pcl + 1);
 					if (ulen <= tlen) {		/* Store the length and top of the fragment */
 						*tbl++ = ncl; *tbl++ = tcl;
@@ -3989,11 +5746,13 @@ FRESULT f_lseek (
 #if !FF_FS_TINY
 #if !FF_FS_READONLY
 					if (fp->flag & FA_DIRTY) {		/* Write-back dirty sector cache */
-						if (disk_write(fs->pdrv, fp->buf, fp->sect, 1) != RES_OK) ABORT(fs, FR_DISK_ERR);
+						FST_ADD(fp, dat_write, 1);
+						if (FST_IO(fp, disk_write(fs->pdrv, fp->buf, fp->sect, 1)) != RES_OK) ABORT(fs, FR_DISK_ERR);
 						fp->flag &= (BYTE)~FA_DIRTY;
 					}
 #endif
-					if (disk_read(fs->pdrv, fp->buf, dsc, 1) != RES_OK) ABORT(fs, FR_DISK_ERR);	/* Load current sector */
+					FST_ADD(fp, dat_read, 1);
+					if (FST_IO(fp, disk_read(fs->pdrv, fp->buf, dsc, 1)) != RES_OK) ABORT(fs, FR_DISK_ERR);	/* Load current sector */
 #endif
 					fp->sect = dsc;
 				}
@@ -4020,9 +5779,16 @@ FRESULT f_lseek (
 				clst = fp->obj.sclust;					/* start from the first cluster */
 #if !FF_FS_READONLY
 				if (clst == 0) {						/* If no cluster chain, create a new chain */
+#if FF_ALLOC_NEAR
+					alloc_near(fs, fp->dir_sect);
+#endif
+#if FF_ALLOC_ZONE
+					alloc_zone(fp, ofs);
+#endif
 					clst = create_chain(&fp->obj, 0);
 					if (clst == 1) ABORT(fs, FR_INT_ERR);
 					if (clst == 0xFFFFFFFF) ABORT(fs, FR_DISK_ERR);
+					if (clst != 0) FST_ADD(fp, clst_alloc, 1);
 					fp->obj.sclust = clst;
 				}
 #endif
@@ -4033,14 +5799,21 @@ FRESULT f_lseek (
 					ofs -= bcs; fp->fptr += bcs;
 #if !FF_FS_READONLY
 					if (fp->flag & FA_WRITE) {			/* Check if in write mode or not */
+#if FF_ALLOC_ZONE
+						if (fp->fptr >= fp->obj.objsize) alloc_zone(fp, fp->fptr + ofs);
+#endif
 						clst = create_chain(&fp->obj, clst);	/* Follow chain with forceed stretch */
 						if (clst == 0) {				/* Clip file size in case of disk full */
 							ofs = 0; break;
 						}
+#if FF_USE_FILESTAT
+						if (fp->fptr >= fp->obj.objsize) fp->fst.clst_alloc++; else fp->fst.fat_get++;
+#endif
 					} else
 #endif
 					{
 						clst = get_fat(&fp->obj, clst);	/* Follow cluster chain if not in write mode */
+						FST_ADD(fp, fat_get, 1);
 					}
 					if (clst == 0xFFFFFFFF) ABORT(fs, FR_DISK_ERR);
 					if (clst <= 1 || clst >= fs->n_fatent) ABORT(fs, FR_INT_ERR);
@@ -4062,11 +5835,13 @@ FRESULT f_lseek (
 #if !FF_FS_TINY
 #if !FF_FS_READONLY
 			if (fp->flag & FA_DIRTY) {			/* Write-back dirty sector cache */
-				if (disk_write(fs->pdrv, fp->buf, fp->sect, 1) != RES_OK) ABORT(fs, FR_DISK_ERR);
+				FST_ADD(fp, dat_write, 1);
+				if (FST_IO(fp, disk_write(fs->pdrv, fp->buf, fp->sect, 1)) != RES_OK) ABORT(fs, FR_DISK_ERR);
 				fp->flag &= (BYTE)~FA_DIRTY;
 			}
 #endif
-			if (disk_read(fs->pdrv, fp->buf, nsect, 1) != RES_OK) ABORT(fs, FR_DISK_ERR);	/* Fill sector cache */
+			FST_ADD(fp, dat_read, 1);
+			if (FST_IO(fp, disk_read(fs->pdrv, fp->buf, nsect, 1)) != RES_OK) ABORT(fs, FR_DISK_ERR);	/* Fill sector cache */
 #endif
 			fp->sect = nsect;
 		}
@@ -4149,7 +5924,7 @@ FRESULT f_closedir (
 	res = validate(&dp->obj, &fs);	/* Check validity of the file object */
 	if (res == FR_OK) {
 #if FF_FS_LOCK != 0
-		if (dp->obj.lockid) res = dec_lock(dp->obj.lockid);	/* Decrement sub-directory open counter */
+		if (dp->obj.lockid) res = dec_lock(dp->obj.fs, dp->obj.lockid);	/* Decrement sub-directory open counter */
 		if (res == FR_OK) dp->obj.fs = 0;	/* Invalidate directory object */
 #else
 		dp->obj.fs = 0;	/* Invalidate directory object */
@@ -4256,7 +6031,8 @@ FRESULT f_findfirst (
 /* Get File Status                                                       */
 /*-----------------------------------------------------------------------*/
 
-FRESULT f_stat (
+static FRESULT stat_at (
+	DIR* base,			/* Directory the file path is relative to (NULL:path with drive prefix) */
 	const TCHAR* path,	/* Pointer to the file path */
 	FILINFO* fno		/* Pointer to file information to return */
 )
@@ -4267,10 +6043,10 @@ FRESULT f_stat (
 
 
 	/* Get logical drive */
-	res = find_volume(&path, &dj.obj.fs, 0);
+	res = base ? find_base(base, &dj.obj.fs, 0) : find_volume(&path, &dj.obj.fs, 0);
 	if (res == FR_OK) {
 		INIT_NAMBUF(dj.obj.fs);
-		res = follow_path(&dj, path);	/* Follow the file path */
+		res = follow_path_at(&dj, base, path);	/* Follow the file path */
 		if (res == FR_OK) {				/* Follow completed */
 			if (dj.fn[NSFLAG] & NS_NONAME) {	/* It is origin directory */
 				res = FR_INVALID_NAME;
@@ -4285,6 +6061,97 @@ FRESULT f_stat (
 }
 
 
+FRESULT f_stat (
+	const TCHAR* path,	/* Pointer to the file path */
+	FILINFO* fno		/* Pointer to file information to return */
+)
+{
+	return stat_at(0, path, fno);
+}
+
+
+#if FF_USE_OPENAT
+FRESULT f_stat_at (
+	DIR* dp,			/* Pointer to the open directory the name is relative to */
+	const TCHAR* name,	/* Pointer to the file name */
+	FILINFO* fno		/* Pointer to file information to return */
+)
+{
+	if (!dp) return FR_INVALID_OBJECT;
+	return stat_at(dp, name, fno);
+}
+#endif
+
+
+
+#if FF_USE_LFN && FF_DIR_ALIGN
+/*-----------------------------------------------------------------------*/
+/* Count Entry Blocks Across Sectors in a Directory                      */
+/*-----------------------------------------------------------------------*/
+
+FRESULT f_getdirblk (
+	const TCHAR* path,	/* Pointer to the directory path */
+	UINT* nblk,			/* Pointer to the variable to return number of LFN entry blocks */
+	UINT* nstr			/* Pointer to the variable to return number of the blocks across sectors */
+)
+{
+	FRESULT res;
+	DIR dj;
+	FATFS *fs;
+	DWORD sofs = 0xFFFFFFFF;	/* Offset of the top entry of current block (0xFFFFFFFF:none) */
+	UINT nb = 0, ns = 0;
+	BYTE c, a;
+	DEF_NAMBUF
+
+
+	if (!nblk || !nstr) return FR_INVALID_PARAMETER;
+
+	/* Get logical drive */
+	res = find_volume(&path, &fs, 0);
+	if (res == FR_OK) {
+		dj.obj.fs = fs;
+		INIT_NAMBUF(fs);
+		res = follow_path(&dj, path);			/* Follow the path to the directory */
+		if (res == FR_OK && !(dj.fn[NSFLAG] & NS_NONAME)) {	/* It is not the origin directory itself */
+			if (dj.obj.attr & AM_DIR) {
+				dj.obj.sclust = ld_clust(fs, dj.dir);
+			} else {
+				res = FR_NO_DIR;
+			}
+		}
+		FREE_NAMBUF();
+		if (res == FR_NO_FILE) res = FR_NO_PATH;
+		if (res == FR_OK) res = dir_sdi(&dj, 0);
+		while (res == FR_OK) {					/* Scan all entries in the directory */
+			res = move_window(fs, dj.sect);
+			if (res != FR_OK) break;
+			c = dj.dir[DIR_Name];
+			if (c == 0) break;					/* End of table */
+			a = dj.dir[DIR_Attr] & AM_MASK;
+			if (c == DDEM) {
+				sofs = 0xFFFFFFFF;
+			} else if (a == AM_LFN) {
+				if (c & LLEF) sofs = dj.dptr;	/* Top of an LFN entry block */
+			} else {
+				if (sofs != 0xFFFFFFFF) {		/* SFN entry which closes an LFN entry block */
+					nb++;
+					if (sofs / SS(fs) != dj.dptr / SS(fs)) ns++;
+				}
+				sofs = 0xFFFFFFFF;
+			}
+			res = dir_next(&dj, 0);
+		}
+		if (res == FR_NO_FILE) res = FR_OK;
+		if (res == FR_OK) {
+			*nblk = nb; *nstr = ns;
+		}
+	}
+
+	LEAVE_FF(fs, res);
+}
+#endif	/* FF_USE_LFN && FF_DIR_ALIGN */
+
+
 
 #if !FF_FS_READONLY
 /*-----------------------------------------------------------------------*/
@@ -4303,6 +6170,9 @@ FRESULT f_getfree (
 	QWORD sect;
 	UINT i;
 	FFOBJID obj;
+#if FF_FS_REENTRANT && FF_FS_MAXHOLD
+	DWORD mcnt;
+#endif
 
 
 	/* Get logical drive */
@@ -4315,13 +6185,28 @@ FRESULT f_getfree (
 		} else {
 			/* Scan FAT to obtain number of free clusters */
 			nfree = 0;
+#if FF_FS_REENTRANT && FF_FS_MAXHOLD
+			hold_start(fs, HS_GETFREE);
+			mcnt = fs->modcnt;
+#endif
+#if FF_USE_FREEMAP
+			mem_set(fs->fmap, 0, sizeof fs->fmap);	/* Rebuild the free cluster map */
+#endif
 			if (fs->fs_type == FS_FAT12) {	/* FAT12: Scan bit field FAT entries */
 				clst = 2; obj.fs = fs;
 				do {
+#if FF_FS_REENTRANT && FF_FS_MAXHOLD
+					if (hold_due(fs) && (res = hold_yield(fs)) != FR_OK) break;	/* Yield the volume if held too long */
+#endif
 					stat = get_fat(&obj, clst);
 					if (stat == 0xFFFFFFFF) { res = FR_DISK_ERR; break; }
 					if (stat == 1) { res = FR_INT_ERR; break; }
-					if (stat == 0) nfree++;
+					if (stat == 0) {
+						nfree++;
+#if FF_USE_FREEMAP
+						fmap_set(fs, clst, 1);
+#endif
+					}
 				} while (++clst < fs->n_fatent);
 			} else {
 				/* FAT16/32: Scan WORD/DWORD FAT entries */
@@ -4330,19 +6215,38 @@ FRESULT f_getfree (
 				i = 0;					/* Offset in the sector */
 				do {	/* Counts numbuer of entries with zero in the FAT */
 					if (i == 0) {
+#if FF_FS_REENTRANT && FF_FS_MAXHOLD
+						if (hold_due(fs) && (res = hold_yield(fs)) != FR_OK) break;	/* Yield the volume at a FAT sector boundary */
+#endif
 						res = move_window(fs, sect++);
 						if (res != FR_OK) break;
 					}
 					if (fs->fs_type == FS_FAT16) {
-						if (ld_word(fs->win + i) == 0) nfree++;
+						stat = ld_word(fs->win + i);
 						i += 2;
 					} else {
-						if ((ld_dword(fs->win + i) & 0x0FFFFFFF) == 0) nfree++;
+						stat = ld_dword(fs->win + i) & 0x0FFFFFFF;
 						i += 4;
 					}
+					if (stat == 0) {
+						nfree++;
+#if FF_USE_FREEMAP
+						fmap_set(fs, fs->n_fatent - clst, 1);
+#endif
+					}
 					i %= SS(fs);
 				} while (--clst);
 			}
+#if FF_USE_FREEMAP
+			if (res != FR_OK) fmap_reset(fs);	/* The map is incomplete */
+#endif
+#if FF_FS_REENTRANT && FF_FS_MAXHOLD
+			hold_end(fs);
+			if (res != FR_OK || fs->modcnt != mcnt) {	/* Scan aborted or the FAT has been changed by other task while yielding */
+				*nclst = nfree;			/* Return the free clusters counted (the value is not kept) */
+				LEAVE_FF(fs, res);
+			}
+#endif
 			*nclst = nfree;			/* Return the free clusters */
 			fs->free_clst = nfree;	/* Now free_clst is valid */
 			fs->fsi_flag |= 1;		/* FAT32: FSInfo is to be updated */
@@ -4354,28 +6258,151 @@ FRESULT f_getfree (
 
 
 
-
+#if FF_FS_REENTRANT && FF_FS_MAXHOLD
 /*-----------------------------------------------------------------------*/
-/* Truncate File                                                         */
+/* Get Longest Hold Time of the Volume                                   */
 /*-----------------------------------------------------------------------*/
 
-FRESULT f_getclustinfo(FIL* fp,
-	DWORD* fclust,
-	DWORD* fcount
+FRESULT f_getholdstat (
+	const TCHAR* path,	/* Logical drive number */
+	BYTE op,			/* Operation type (HS_xxx) */
+	DWORD* tmax,		/* Pointer to the variable to return the longest hold time in unit of time tick */
+	BYTE clr			/* Clear the record after read (0:no, 1:yes) */
 )
 {
-	UINT count = 0;
+	FRESULT res;
 	FATFS *fs;
-	FRESULT ret;
-	ret = validate(&fp->obj,&fs);
-	if (ret != FR_OK) LEAVE_FF(fs,ret);
 
-	count = get_clustinfo(fp, fclust);
-	if (count == 0xFFFFFFFF)
-		LEAVE_FF(fs,FR_DENIED);
 
-	*fcount = count;
-	LEAVE_FF(fs,FR_OK);
+	if (op >= HS_NOP || !tmax) return FR_INVALID_PARAMETER;
+
+	/* Get logical drive */
+	res = find_volume(&path, &fs, 0);
+	if (res == FR_OK) {
+		*tmax = fs->hmax[op];
+		if (clr) fs->hmax[op] = 0;
+	}
+
+	LEAVE_FF(fs, res);
+}
+#endif
+
+
+
+
+#if !FF_FS_READONLY && FF_USE_TRIM && FF_TRIM_QUEUE
+/*-----------------------------------------------------------------------*/
+/* Trim the Queued Blocks                                                */
+/*-----------------------------------------------------------------------*/
+
+FRESULT f_flushtrim (
+	const TCHAR* path	/* Logical drive number */
+)
+{
+	FRESULT res;
+	FATFS *fs;
+
+
+	/* Get logical drive */
+	res = find_volume(&path, &fs, FA_WRITE);
+	if (res == FR_OK) {
+		res = sync_fs(fs);
+		if (res == FR_OK) trim_flush(fs);
+	}
+
+	LEAVE_FF(fs, res);
+}
+
+
+
+/*-----------------------------------------------------------------------*/
+/* Get Statistics of the Trim Queue                                      */
+/*-----------------------------------------------------------------------*/
+
+FRESULT f_gettrimstat (
+	const TCHAR* path,	/* Logical drive number */
+	DWORD* st,			/* Pointer to the array to return the counts of blocks queued, merged, trimmed and dropped */
+	BYTE clr			/* Clear the counts after read (0:no, 1:yes) */
+)
+{
+	FRESULT res;
+	FATFS *fs, *qfs;
+
+
+	if (!st) return FR_INVALID_PARAMETER;
+
+	/* Get logical drive */
+	res = find_volume(&path, &fs, 0);
+	if (res == FR_OK) {
+		qfs = fs;
+#ifdef LOSCFG_FS_FAT_VIRTUAL_PARTITION
+		if (ISCHILD(fs)) qfs = PARENTFS(fs);	/* The queue is kept in the parent */
+#endif
+		mem_cpy(st, qfs->tq_stat, sizeof qfs->tq_stat);
+		if (clr) mem_set(qfs->tq_stat, 0, sizeof qfs->tq_stat);
+	}
+
+	LEAVE_FF(fs, res);
+}
+#endif
+
+
+
+
+#if FF_USE_FILESTAT
+/*-----------------------------------------------------------------------*/
+/* Get I/O Counters of the File                                          */
+/*-----------------------------------------------------------------------*/
+
+FRESULT f_getfilestats (
+	FIL* fp,			/* Pointer to the file object */
+	FFFSTAT* st,		/* Pointer to the structure to return the counters */
+	BYTE clr			/* Clear the counters after read (0:no, 1:yes) */
+)
+{
+	FRESULT res;
+	FATFS *fs;
+	DWORD dir;
+
+
+	if (!st) return FR_INVALID_PARAMETER;
+	res = validate(&fp->obj, &fs);	/* Check validity of the file object */
+	if (res == FR_OK) {
+		mem_cpy(st, &fp->fst, sizeof (FFFSTAT));
+		if (clr) {
+			dir = fp->fst.dir;
+			mem_set(&fp->fst, 0, sizeof (FFFSTAT));
+			fp->fst.dir = dir;
+		}
+	}
+	LEAVE_FF(fs, res);
+}
+#endif
+
+
+
+
+/*-----------------------------------------------------------------------*/
+/* Truncate File                                                         */
+/*-----------------------------------------------------------------------*/
+
+FRESULT f_getclustinfo(FIL* fp,
+	DWORD* fclust,
+	DWORD* fcount
+)
+{
+	UINT count = 0;
+	FATFS *fs;
+	FRESULT ret;
+	ret = validate(&fp->obj,&fs);
+	if (ret != FR_OK) LEAVE_FF(fs,ret);
+
+	count = get_clustinfo(fp, fclust);
+	if (count == 0xFFFFFFFF)
+		LEAVE_FF(fs,FR_INT_ERR);
+
+	*fcount = count;
+	LEAVE_FF(fs,FR_OK);
 }
 
 FRESULT f_truncate (
@@ -4386,6 +6413,7 @@ FRESULT f_truncate (
 	FRESULT res;
 	FATFS *fs;
 	DWORD n, tcl, val, count, fclust = 0;
+	CHWALK cw;
 
 	res = validate(&fp->obj, &fs);	/* Check validity of the file object */
 	if (res != FR_OK || (res = (FRESULT)fp->err) != FR_OK) LEAVE_FF(fs, res);
@@ -4393,26 +6421,40 @@ FRESULT f_truncate (
 
 	if (fp->fptr <= fp->obj.objsize) {	/* Process when fptr is not on the eof */
 		if (fp->fptr == 0 && length == 0) {	/* When set file size to zero, remove entire cluster chain */
+#if FF_FS_REENTRANT && FF_FS_MAXHOLD
+			hold_start(fs, HS_REMOVE);
+#endif
 			res = remove_chain(&fp->obj, fp->obj.sclust, 0);
+#if FF_FS_REENTRANT && FF_FS_MAXHOLD
+			hold_end(fs);
+#endif
 			fp->obj.sclust = 0;
 		} else {	/* When truncate a part of the file, remove remaining clusters */
 			n = (DWORD)fs->csize * SS(fs);	/* Cluster size */
 			tcl = (DWORD)(length / n) + ((length & (n - 1)) ? 1 : 0);	/* Number of clusters required */
 			val = fp->obj.sclust;
 			count = 0;
+			chain_init(&cw, fs, val);
 			do {
 				fclust = val;
 				val = get_fat(&fp->obj, fclust);
 				count ++;
 				if (count == tcl)
 					break;
+				if (val >= 2 && val < fs->n_fatent && chain_chk(&cw, val)) val = 1;	/* Broken chain? */
 			} while ((val != 0x0FFFFFFF) && (val != 1) && (val != 0xFFFFFFFF));
 
 			res = FR_OK;
 			if (val == 0xFFFFFFFF) res = FR_DISK_ERR;
 			if (val == 1) res = FR_INT_ERR;
 			if (res == FR_OK && val < fs->n_fatent) {
+#if FF_FS_REENTRANT && FF_FS_MAXHOLD
+				hold_start(fs, HS_REMOVE);	/* The remaining chain is cut off from the file first */
+#endif
 				res = remove_chain(&fp->obj, val, fclust);
+#if FF_FS_REENTRANT && FF_FS_MAXHOLD
+				hold_end(fs);
+#endif
 			}
 		}
 
@@ -4453,7 +6495,8 @@ FRESULT f_truncate (
 /* Delete a File/Directory                                               */
 /*-----------------------------------------------------------------------*/
 
-FRESULT f_unlink (
+static FRESULT unlink_at (
+	DIR* base,				/* Directory the path is relative to (NULL:path with drive prefix) */
 	const TCHAR* path		/* Pointer to the file or directory path */
 )
 {
@@ -4467,12 +6510,13 @@ FRESULT f_unlink (
 #ifdef LOSCFG_FS_FAT_VIRTUAL_PARTITION
 	DWORD rtclst = 0;
 	DWORD st_bak = 0;
+	CHWALK cw;
 #endif
 	DEF_NAMBUF
 
 
 	/* Get logical drive */
-	res = find_volume(&path, &fs, FA_WRITE);
+	res = base ? find_base(base, &fs, FA_WRITE) : find_volume(&path, &fs, FA_WRITE);
 	dj.obj.fs = fs;
 #if FF_FS_REENTRANT
 	fs_bak = fs;
@@ -4480,11 +6524,11 @@ FRESULT f_unlink (
 	if (res == FR_OK) {
 #ifdef LOSCFG_FS_FAT_VIRTUAL_PARTITION
 #if FF_FS_REENTRANT
-		if (ISCHILD(fs)) LEAVE_FF(fs_bak,FR_INVAILD_FATFS);
+		if (!base && ISCHILD(fs)) LEAVE_FF(fs_bak,FR_INVAILD_FATFS);
 #else
-		if (ISCHILD(fs)) LEAVE_FF(fs,FR_INVAILD_FATFS);
+		if (!base && ISCHILD(fs)) LEAVE_FF(fs,FR_INVAILD_FATFS);
 #endif
-		if (ISVIRPART(fs)) {
+		if (!base && ISVIRPART(fs)) {	/* (A base directory is already in the virtual partition) */
 			/* Check the virtual partition top directory, and match the virtual fs */
 			res = follow_virentry(&dj.obj,path);
 #if FF_FS_REENTRANT
@@ -4497,7 +6541,7 @@ FRESULT f_unlink (
 		}
 #endif
 		INIT_NAMBUF(fs);
-		res = follow_path(&dj, path);		/* Follow the file path */
+		res = follow_path_at(&dj, base, path);	/* Follow the file path */
 		if (FF_FS_RPATH && res == FR_OK && (dj.fn[NSFLAG] & NS_DOT)) {
 			res = FR_INVALID_NAME;			/* Cannot remove dot entry */
 		}
@@ -4505,6 +6549,7 @@ FRESULT f_unlink (
 		if (res == FR_OK && ISVIRPART(fs)) {
 			dj.atrootdir = 0;rtclst = 2;
 			st_bak = PARENTFS(dj.obj.fs)->winsect;
+			chain_init(&cw, fs, rtclst);
 			/* Follow the root directory cluster chain */
 			for (;;) {
 #if FF_FS_REENTRANT
@@ -4527,6 +6572,7 @@ FRESULT f_unlink (
 					break;
 				}
 				rtclst = get_fat(&(dj.obj),rtclst);
+				if (rtclst >= 2 && rtclst < fs->n_fatent && chain_chk(&cw, rtclst)) rtclst = 1;	/* Broken chain? */
 			}
 			/* If current item is on rootdir clust chain */
 			if (dj.atrootdir == 1) {
@@ -4577,7 +6623,13 @@ FRESULT f_unlink (
 			if (res == FR_OK) {
 				res = dir_remove(&dj);		/* Remove the directory entry */
 				if (res == FR_OK && dclst) {	/* Remove the cluster chain if exist */
+#if FF_FS_REENTRANT && FF_FS_MAXHOLD
+					hold_start(fs, HS_REMOVE);	/* The chain is no longer reachable */
+#endif
 					res = remove_chain(&dj.obj, dclst, 0);
+#if FF_FS_REENTRANT && FF_FS_MAXHOLD
+					hold_end(fs);
+#endif
 				}
 				if (res == FR_OK) res = sync_fs(fs);
 			}
@@ -4592,137 +6644,138 @@ FRESULT f_unlink (
 }
 
 
+FRESULT f_unlink (
+	const TCHAR* path		/* Pointer to the file or directory path */
+)
+{
+	return unlink_at(0, path);
+}
+
+
+#if FF_USE_OPENAT
+FRESULT f_unlink_at (
+	DIR* dp,				/* Pointer to the open directory the name is relative to */
+	const TCHAR* name		/* Pointer to the file or directory name */
+)
+{
+	if (!dp) return FR_INVALID_OBJECT;
+	return unlink_at(dp, name);
+}
+#endif
+
+
 
 
+#if FF_USE_UNLINK_MANY
 /*-----------------------------------------------------------------------*/
-/* Create a Directory                                                    */
+/* Delete the Files Matching a Name List in a Directory                  */
 /*-----------------------------------------------------------------------*/
 
-FRESULT f_mkdir (
-	const TCHAR* path		/* Pointer to the directory path */
+FRESULT f_unlink_many (
+	const TCHAR* path,			/* Pointer to the directory path */
+	const TCHAR* const* names,	/* List of names or wildcard patterns of the files to be removed */
+	UINT cnt,					/* Number of items in the list */
+	BYTE opt,					/* Options (UM_STRICT and/or UM_FORCE) */
+	UINT* ndel					/* Pointer to the variable to return number of removed files (can be null) */
 )
 {
-	FRESULT res;
+	FRESULT res, rs = FR_OK;
 	DIR dj;
+	FILINFO fno;
 	FATFS *fs;
 #if FF_FS_REENTRANT
 	FATFS *fs_bak;
 #endif
-	BYTE *dir;
-	UINT n;
-	DWORD dcl, pcl, tm;
-	QWORD dsc;
-	FFOBJID sobj;
+	DWORD dclst, bcl[N_CHBATCH];
+	UINT i, nb = 0, nd = 0;
 	DEF_NAMBUF
 
 
+	if (ndel) *ndel = 0;
+	if (!names || !cnt) return FR_INVALID_PARAMETER;
+
 	/* Get logical drive */
 	res = find_volume(&path, &fs, FA_WRITE);
 	dj.obj.fs = fs;
 #if FF_FS_REENTRANT
 	fs_bak = fs;
 #endif
-	dj.obj.sclust = 0;
 	if (res == FR_OK) {
 #ifdef LOSCFG_FS_FAT_VIRTUAL_PARTITION
-#if FF_FS_REENTRANT
-		if (ISCHILD(fs)) LEAVE_FF(fs_bak,FR_INVAILD_FATFS);
-#else
-		if (ISCHILD(fs)) LEAVE_FF(fs,FR_INVAILD_FATFS);
-#endif
-		if (ISVIRPART(fs)) {
+		if (ISCHILD(fs)) res = FR_INVAILD_FATFS;
+		if (res == FR_OK && ISVIRPART(fs)) {
 			/* Check the virtual partition top directory, and match the virtual fs */
-			res = follow_virentry(&dj.obj,path);
-#if FF_FS_REENTRANT
-			if (res == FR_INT_ERR) LEAVE_FF(fs_bak,res);
-#else
-			if (res == FR_INT_ERR) LEAVE_FF(fs,res);
-#endif
-			if (res == FR_OK)
-				fs = dj.obj.fs;
+			res = follow_virentry(&dj.obj, path);
+			if (res == FR_OK) fs = dj.obj.fs;
+			if (res != FR_INT_ERR) res = FR_OK;
 		}
+		if (res == FR_OK) {
 #endif
 		INIT_NAMBUF(fs);
-		res = follow_path(&dj, path);			/* Follow the file path */
-		if (res == FR_OK) res = FR_EXIST;		/* Name collision? */
-		if (FF_FS_RPATH && res == FR_NO_FILE && (dj.fn[NSFLAG] & NS_DOT)) {	/* Invalid name? */
-			res = FR_INVALID_NAME;
+		res = follow_path(&dj, path);			/* Follow the path to the directory */
+		if (res == FR_OK && !(dj.fn[NSFLAG] & NS_NONAME)) {	/* It is not the origin directory itself */
+			if (dj.obj.attr & AM_DIR) {
+				dj.obj.sclust = ld_clust(fs, dj.dir);
+			} else {
+				res = FR_NO_DIR;
+			}
 		}
-		if (res == FR_NO_FILE) {				/* It is clear to create a new directory */
-			sobj.fs = fs;						/* New object id to create a new chain */
-			dcl = create_chain(&sobj, 0);		/* Allocate a cluster for the new directory */
-			res = FR_OK;
-			if (dcl == 0) res = FR_NO_SPACE_LEFT;	/* No space to allocate a new cluster */
-			if (dcl == 1) res = FR_INT_ERR;			/* Any insanity? */
-			if (dcl == 0xFFFFFFFF) res = FR_DISK_ERR;	/* Disk error? */
-			if (res == FR_OK) res = sync_window(fs);	/* Flush FAT */
-			tm = GET_FATTIME();
-			if (res == FR_OK) {					/* Initialize the new directory table */
-				dsc = clst2sect(fs, dcl);
-#ifndef LOSCFG_FS_FAT_VIRTUAL_PARTITION
-				dir = fs->win;
-#else
-				dir = PARENTFS(fs)->win;
-#endif
-				mem_set(dir, 0, SS(fs));
-				mem_set(dir + DIR_Name, ' ', 11);	/* Create "." entry */
-				dir[DIR_Name] = '.';
-				dir[DIR_Attr] = AM_DIR;
-				if (SYSTEM_TIME_ENABLE == time_status) {
-					st_dword(dir + DIR_ModTime, tm);
-				} else if (SYSTEM_TIME_DISABLE == time_status) {
-					st_dword(dir + DIR_ModTime, 0);
-				}
-				st_clust(fs, dir, dcl);
-				mem_cpy(dir + SZDIRE, dir, SZDIRE);	/* Create ".." entry */
-				dir[SZDIRE + 1] = '.'; pcl = dj.obj.sclust;
-				if (fs->fs_type == FS_FAT32 && pcl == fs->dirbase) pcl = 0;
-				st_clust(fs, dir + SZDIRE, pcl);
-
-				for (n = fs->csize; n; n--) {	/* Write dot entries and clear following sectors */
-#ifndef LOSCFG_FS_FAT_VIRTUAL_PARTITION
-					fs->winsect = dsc++;
-					fs->wflag = 1;
-					res = sync_window(fs);
-					if (res != FR_OK) break;
-					mem_set(dir, 0, SS(fs));
-#else
-					PARENTFS(fs)->winsect = dsc++;
-					PARENTFS(fs)->wflag = 1;
-					res = sync_window(fs);
-					if (res != FR_OK) break;
-					mem_set(dir, 0, SS(fs));
+		if (res == FR_NO_FILE) res = FR_NO_PATH;
+		if (res == FR_OK) res = dir_sdi(&dj, 0);	/* Rewind the directory */
+		while (res == FR_OK) {
+			res = DIR_READ_FILE(&dj);			/* Get an item */
+			if (res != FR_OK) break;
+			if (!(dj.obj.attr & AM_DIR)) {		/* Sub-directories are never removed */
+				get_fileinfo(&dj, &fno);
+				for (i = 0; i < cnt; i++) {		/* Test the name against the list */
+					if (names[i] && pattern_matching(names[i], fno.fname, 0, 0)) break;
+#if FF_USE_LFN
+					if (names[i] && pattern_matching(names[i], fno.altname, 0, 0)) break;
 #endif
 				}
-			}
-			if (res == FR_OK) {
-				res = dir_register(&dj);	/* Register the object to the directoy */
-			}
-			if (res == FR_OK) {
-				dir = dj.dir;
-				if (SYSTEM_TIME_ENABLE == time_status) {
-					st_dword(dir + DIR_ModTime, tm);	/* Created time */
-				}
-				else if (SYSTEM_TIME_DISABLE == time_status)
-				{
-					st_dword(dir + DIR_ModTime, 0);		/* Created time */
-				}
-				st_clust(fs, dir, dcl);		/* Table start cluster */
-				dir[DIR_Attr] = AM_DIR;		/* Attribute */
-#ifndef LOSCFG_FS_FAT_VIRTUAL_PARTITION
-				fs->wflag = 1;
-#else
-				PARENTFS(fs)->wflag = 1;
+				if (i < cnt) {					/* The file is to be removed */
+					if ((dj.obj.attr & AM_RDO) && !(opt & UM_FORCE)) {
+						if (rs == FR_OK) rs = FR_DENIED;	/* Cannot remove R/O file */
+#if FF_FS_LOCK != 0
+					} else if (chk_lock(&dj, 2) != FR_OK) {
+						if (rs == FR_OK) rs = FR_LOCKED;	/* Cannot remove an open file */
 #endif
-				if (res == FR_OK) {
-					res = sync_fs(fs);
+					} else {
+						dclst = ld_clust(fs, dj.dir);
+						res = dir_remove(&dj);	/* Mark the entry block 'deleted' in the window (written back when the window moves) */
+						if (res != FR_OK) break;
+						nd++;
+						if (dclst) {			/* Defer freeing the chain to reduce window thrashing between directory and FAT */
+							bcl[nb++] = dclst;
+							if (nb == N_CHBATCH) {
+								res = free_chains(&dj.obj, bcl, nb);
+								nb = 0;
+								if (res != FR_OK) break;
+							}
+						}
+					}
+					if (rs != FR_OK && (opt & UM_STRICT)) break;
 				}
-			} else {
-				remove_chain(&dj.obj, dcl, 0);	/* Could not register, remove cluster chain */
 			}
+			res = dir_next(&dj, 0);				/* Next item */
+		}
+		if (res == FR_NO_FILE) res = FR_OK;		/* Reached end of the directory */
+		if (nb) {								/* Free the rest of the chains even if any error occurred */
+			FRESULT rc = free_chains(&dj.obj, bcl, nb);
+			if (res == FR_OK) res = rc;
 		}
+		if (nd) {
+			FRESULT rc = sync_fs(fs);
+			if (res == FR_OK) res = rc;
+		}
+		if (res == FR_OK) res = rs;				/* Report a file which was not removed */
 		FREE_NAMBUF();
+#ifdef LOSCFG_FS_FAT_VIRTUAL_PARTITION
+		}
+#endif
 	}
+	if (ndel) *ndel = nd;
+
 #if FF_FS_REENTRANT
 	LEAVE_FF(fs_bak, res);
 #else
@@ -4730,27 +6783,1025 @@ FRESULT f_mkdir (
 #endif
 }
 
+#endif	/* FF_USE_UNLINK_MANY */
+
+
+
+#if FF_USE_RMTREE
 /*-----------------------------------------------------------------------*/
-/* Rename a File/Directory                                               */
+/* Delete a Directory Tree                                               */
 /*-----------------------------------------------------------------------*/
 
-FRESULT f_rename (
-	const TCHAR* path_old,	/* Pointer to the object name to be renamed */
-	const TCHAR* path_new	/* Pointer to the new name */
+#define N_RTLEVEL	8	/* Number of directory levels whose return position is held by f_rmtree() */
+
+static FRESULT ld_dotdot (	/* FR_OK(0):succeeded, !=0:error */
+	DIR* dp,			/* Work directory object (obj.fs needs to be set) */
+	DWORD clst,			/* Top cluster of the sub-directory */
+	DWORD* pclst		/* Pointer to the variable to return top cluster of the parent directory (0:root) */
 )
 {
 	FRESULT res;
-	DIR djo, djn;
-	FATFS *fs;
-#if FF_FS_REENTRANT
-	FATFS *fs_bak;
-#endif
-	BYTE buf[SZDIRE], *dir;
-	QWORD dw;
-#ifdef LOSCFG_FS_FAT_VIRTUAL_PARTITION
-	DWORD rtclst = 0;
-	DWORD st_bak = 0;
-#endif
+
+
+	dp->obj.sclust = clst;
+	res = dir_sdi(dp, SZDIRE);		/* The dot-dot entry is the second entry of the sub-directory */
+	if (res == FR_OK) res = move_window(dp->obj.fs, dp->sect);
+	if (res == FR_OK) {
+		if (dp->dir[DIR_Name] != '.' || dp->dir[DIR_Name + 1] != '.') return FR_INT_ERR;	/* Broken sub-directory? */
+		*pclst = ld_clust(dp->obj.fs, dp->dir);
+	}
+	return res;
+}
+
+
+static FRESULT chk_subtree (	/* FR_OK:In the tree, FR_NO_FILE:Out of the tree, others:error */
+	DIR* dp,			/* Work directory object (obj.fs needs to be set) */
+	DWORD top,			/* Top cluster of the tree (0:root directory) */
+	DWORD clst			/* Top cluster of the directory to be checked (0:root directory) */
+)
+{
+	FRESULT res = FR_OK;
+	FATFS *fs = dp->obj.fs;
+	DWORD n;
+
+
+	if (fs->fs_type == FS_FAT32 && clst == fs->dirbase) clst = 0;
+	for (n = 0; res == FR_OK; n++) {	/* Go up the ancestors until the tree top or root directory is found */
+		if (clst == top) return FR_OK;
+		if (clst == 0) return FR_NO_FILE;
+		if (n >= fs->n_fatent) return FR_INT_ERR;	/* Circular link? */
+		res = ld_dotdot(dp, clst, &clst);
+	}
+	return res;
+}
+
+
+static FRESULT find_subdir (	/* FR_OK(0):succeeded, !=0:error */
+	DIR* dp,			/* Directory object to be pointed to the entry of the sub-directory */
+	DWORD clst			/* Top cluster of the sub-directory */
+)
+{
+	FRESULT res;
+	DWORD pclst;
+
+
+	res = ld_dotdot(dp, clst, &pclst);	/* Get the parent directory */
+	if (res == FR_OK) {
+		dp->obj.sclust = pclst;
+		res = dir_sdi(dp, 0);
+	}
+	while (res == FR_OK) {				/* Find the entry of the sub-directory in the parent directory */
+		res = DIR_READ_FILE(dp);
+		if (res != FR_OK) break;
+		if ((dp->obj.attr & AM_DIR) && ld_clust(dp->obj.fs, dp->dir) == clst) break;
+		res = dir_next(dp, 0);
+	}
+	if (res == FR_NO_FILE) res = FR_INT_ERR;	/* Not found (broken tree) */
+	return res;
+}
+
+
+FRESULT f_rmtree (
+	const TCHAR* path,		/* Pointer to the directory path */
+	BYTE opt				/* Options (RT_CONTENT) */
+)
+{
+	FRESULT res;
+	DIR dj, sd;
+	FATFS *fs;
+#if FF_FS_REENTRANT
+	FATFS *fs_bak;
+#endif
+#ifdef LOSCFG_FS_FAT_VIRTUAL_PARTITION
+	DWORD rtclst;
+	CHWALK cw;
+#endif
+	DWORD top = 0, dclst, bcl[N_CHBATCH], stk[N_RTLEVEL][2];
+	UINT nb = 0, lv = 0;
+#if FF_FS_LOCK != 0
+	UINT i;
+#endif
+	DEF_NAMBUF
+
+
+	/* Get logical drive */
+	res = find_volume(&path, &fs, FA_WRITE);
+	dj.obj.fs = fs;
+#if FF_FS_REENTRANT
+	fs_bak = fs;
+#endif
+	if (res == FR_OK) {
+#ifdef LOSCFG_FS_FAT_VIRTUAL_PARTITION
+		if (ISCHILD(fs)) res = FR_INVAILD_FATFS;
+		if (res == FR_OK && ISVIRPART(fs)) {
+			/* Check the virtual partition top directory, and match the virtual fs */
+			res = follow_virentry(&dj.obj, path);
+			if (res == FR_OK) fs = dj.obj.fs;
+			if (res != FR_INT_ERR) res = FR_OK;
+		}
+		if (res == FR_OK) {
+#endif
+		INIT_NAMBUF(fs);
+		res = follow_path(&dj, path);		/* Follow the directory path */
+		if (FF_FS_RPATH && res == FR_OK && (dj.fn[NSFLAG] & NS_DOT)) {
+			res = FR_INVALID_NAME;			/* Cannot remove dot entry */
+		}
+		if (res == FR_OK) {
+			if (dj.fn[NSFLAG] & NS_NONAME) {	/* The origin directory can only be emptied */
+				top = dj.obj.sclust;
+				if (!(opt & RT_CONTENT)) res = FR_INVALID_NAME;
+			} else if (!(dj.obj.attr & AM_DIR)) {
+				res = FR_NO_DIR;
+			} else if ((dj.obj.attr & AM_RDO) && !(opt & RT_CONTENT)) {
+				res = FR_DENIED;			/* Cannot remove R/O directory */
+			} else {
+				top = ld_clust(fs, dj.dir);
+				if (top == 0) res = FR_INT_ERR;	/* Broken sub-directory */
+			}
+		}
+#ifdef LOSCFG_FS_FAT_VIRTUAL_PARTITION
+		if (res == FR_OK && ISVIRPART(fs) && ISCHILD(fs) && !(opt & RT_CONTENT)) {
+			/* The virtual partition directory on the root directory cannot be removed */
+			chain_init(&cw, fs, 2);
+			for (rtclst = 2; res == FR_OK && rtclst != 0x0FFFFFFF; ) {
+				if (rtclst == 0xFFFFFFFF) res = FR_DISK_ERR;
+				else if (rtclst < 2 || rtclst >= fs->n_fatent || chain_chk(&cw, rtclst)) res = FR_INT_ERR;
+				else if (dj.clust == rtclst) res = FR_DENIED;
+				else rtclst = get_fat(&dj.obj, rtclst);
+			}
+		}
+#endif
+#if FF_FS_LOCK != 0
+		if (res == FR_OK && !(opt & RT_CONTENT)) res = chk_lock(&dj, 2);	/* Check if the directory itself is open */
+#endif
+		sd.obj.fs = dj.obj.fs;
+#if FF_FS_RPATH != 0
+		if (res == FR_OK && (fs->cdir != top || !(opt & RT_CONTENT))) {	/* Is the current directory in the tree? */
+			res = chk_subtree(&sd, top, fs->cdir);
+			res = (res == FR_OK) ? FR_DENIED : (res == FR_NO_FILE) ? FR_OK : res;
+		}
+#endif
+#if FF_FS_LOCK != 0
+		for (i = 0; res == FR_OK && i < FF_FS_LOCK; i++) {	/* Is there any open object in the tree? */
+			if (LOCKTBL(dj.obj.fs)[i].fs == dj.obj.fs) {
+				res = chk_subtree(&sd, top, LOCKTBL(dj.obj.fs)[i].clu);
+				res = (res == FR_OK) ? FR_LOCKED : (res == FR_NO_FILE) ? FR_OK : res;
+			}
+		}
+#endif
+		if (res == FR_OK && !(opt & RT_CONTENT)) {
+			res = dir_remove(&dj);			/* Detach the tree from the parent directory first */
+		}
+
+		/* Walk the tree depth-first and free the chains of all objects in it. The entries in
+		   the sub-directories are left as they are because their chains are freed as well. */
+		if (res == FR_OK) {
+			sd.obj.sclust = top;
+			res = dir_sdi(&sd, 0);
+		}
+		while (res == FR_OK) {
+			res = DIR_READ_FILE(&sd);		/* Get an item */
+			if (res == FR_OK) {
+				dclst = ld_clust(fs, sd.dir);
+				if (lv == 0 && (opt & RT_CONTENT)) {
+					res = dir_remove(&sd);	/* Remove the entries in the top directory */
+					if (res != FR_OK) break;
+				}
+				if (sd.obj.attr & AM_DIR) {	/* Go into the sub-directory */
+					if (dclst < 2 || dclst >= fs->n_fatent || lv >= fs->n_fatent) {
+						res = FR_INT_ERR; break;	/* Broken or circular tree */
+					}
+					if (lv < N_RTLEVEL) {	/* Save the return position */
+						stk[lv][0] = sd.obj.sclust; stk[lv][1] = sd.dptr;
+					}
+					lv++;
+					sd.obj.sclust = dclst;
+					res = dir_sdi(&sd, 0);
+					continue;
+				}
+				if (dclst) {				/* Free the file chain in batch */
+					if (nb == N_CHBATCH) {
+						res = free_chains(&sd.obj, bcl, nb);
+						nb = 0;
+						if (res != FR_OK) break;
+					}
+					bcl[nb++] = dclst;
+				}
+				res = dir_next(&sd, 0);		/* Next item */
+				if (res == FR_NO_FILE) res = FR_OK;	/* End of the directory is detected at next read */
+				continue;
+			}
+			if (res != FR_NO_FILE || lv == 0) break;	/* Any error or end of the tree */
+
+			/* End of the sub-directory: return to the parent directory */
+			dclst = sd.obj.sclust;
+			lv--;
+			if (lv < N_RTLEVEL) {
+				sd.obj.sclust = stk[lv][0];
+				res = dir_sdi(&sd, stk[lv][1]);
+			} else {						/* Return position was not saved. Find it from the dot-dot entry. */
+				res = find_subdir(&sd, dclst);
+			}
+			if (res == FR_OK) {				/* Free the sub-directory chain in batch */
+				if (nb == N_CHBATCH) {
+					res = free_chains(&sd.obj, bcl, nb);
+					nb = 0;
+				}
+				bcl[nb++] = dclst;
+			}
+			if (res == FR_OK) res = dir_next(&sd, 0);	/* Next item */
+			if (res == FR_NO_FILE) res = FR_OK;
+		}
+		if (res == FR_NO_FILE) res = FR_OK;		/* Reached end of the tree */
+		if (res == FR_OK && !(opt & RT_CONTENT)) {	/* Free the top directory chain */
+			if (nb == N_CHBATCH) {
+				res = free_chains(&sd.obj, bcl, nb);
+				nb = 0;
+			}
+			bcl[nb++] = top;
+		}
+		if (nb) {							/* Free the rest of the chains even if any error occurred */
+			FRESULT rc = free_chains(&sd.obj, bcl, nb);
+			if (res == FR_OK) res = rc;
+		}
+		if (res == FR_OK) res = sync_fs(fs);
+		FREE_NAMBUF();
+#ifdef LOSCFG_FS_FAT_VIRTUAL_PARTITION
+		}
+#endif
+	}
+
+#if FF_FS_REENTRANT
+	LEAVE_FF(fs_bak, res);
+#else
+	LEAVE_FF(fs, res);
+#endif
+}
+
+#endif	/* FF_USE_RMTREE */
+
+
+
+#if FF_USE_BATCH
+/*-----------------------------------------------------------------------*/
+/* Batched File Creation                                                 */
+/*-----------------------------------------------------------------------*/
+
+static int filter_name (	/* 0:The name is not in the filter, 1:The name may be in the filter */
+	FFBATCH* bt,		/* Batch object */
+	DWORD h,			/* Hash value of the name */
+	int add				/* Register the name to the filter */
+)
+{
+	DWORD i, j;
+	int r;
+
+
+	i = h % (FF_BATCH_FILTER * 8);
+	j = (h / (FF_BATCH_FILTER * 8)) % (FF_BATCH_FILTER * 8);
+	r = (bt->flt[i / 8] & (1 << (i % 8))) && (bt->flt[j / 8] & (1 << (j % 8)));
+	if (add) {
+		bt->flt[i / 8] |= 1 << (i % 8);
+		bt->flt[j / 8] |= 1 << (j % 8);
+	}
+	return r;
+}
+
+
+static FRESULT reserve_run (	/* FR_OK(0):succeeded, FR_DENIED:no contiguous free clusters, !=0:error */
+	FFBATCH* bt,		/* Batch object */
+	DWORD ncl			/* Number of clusters needed at least */
+)
+{
+	FRESULT res = FR_OK;
+	FATFS *fs = bt->dir.obj.fs;
+	DWORD cl, cs, scl = 0, len = 0, n;
+
+
+	bt->rs = bt->cur = bt->re = 0;
+	if (fs->free_clst < ncl) return FR_DENIED;	/* No space (it also works when free_clst is not valid) */
+
+	/* Find a contiguous free run from the suggested cluster */
+	cl = fs->last_clst;
+	if (cl < 2 || cl >= fs->n_fatent) cl = 1;
+	for (n = fs->n_fatent - 2; n; n--) {
+		if (++cl >= fs->n_fatent) {			/* Check wrap-around */
+			if (len >= ncl) break;
+			cl = 2; len = 0;
+		}
+		cs = get_fat(&bt->dir.obj, cl);
+		if (cs == 1) return FR_INT_ERR;
+		if (cs == 0xFFFFFFFF) return FR_DISK_ERR;
+		if (cs == 0) {						/* A free cluster */
+			if (len++ == 0) scl = cl;
+			if (len == FF_BATCH_CLST) break;
+		} else {							/* End of the run */
+			if (len >= ncl) break;
+			len = 0;
+		}
+	}
+	if (len < ncl) return FR_DENIED;
+
+	/* Allocate the run as a chain. Each file cuts its part off the chain when it is created. */
+	for (cl = scl; res == FR_OK && cl < scl + len; cl++) {
+		res = put_fat(fs, cl, (cl + 1 < scl + len) ? cl + 1 : 0xFFFFFFFF);
+	}
+	if (res == FR_OK) {
+		if (fs->free_clst <= fs->n_fatent - 2) fs->free_clst -= len;	/* Update FSINFO */
+		fs->last_clst = scl + len - 1;
+		fs->fsi_flag |= 1;
+		bt->rs = bt->cur = scl;
+		bt->re = scl + len;
+	}
+	return res;
+}
+
+
+static FRESULT flush_run (	/* FR_OK(0):succeeded, !=0:error */
+	FFBATCH* bt			/* Batch object */
+)
+{
+	FRESULT res = FR_OK;
+	FATFS *fs = bt->dir.obj.fs;
+	DWORD cl;
+
+
+	for (cl = bt->cur; res == FR_OK && cl < bt->re; cl++) {	/* Release the unused clusters */
+		res = put_fat(fs, cl, 0);
+		if (fs->free_clst < fs->n_fatent - 2) fs->free_clst++;
+		fs->fsi_flag |= 1;
+	}
+	if (res == FR_OK && bt->cur < bt->re) fs->last_clst = bt->cur - 1;	/* Reuse the released clusters next */
+	bt->rs = bt->cur = bt->re = 0;
+	return res;
+}
+
+
+FRESULT f_batch_begin (
+	FFBATCH* bt,		/* Pointer to the blank batch object */
+	const TCHAR* path	/* Pointer to the directory path */
+)
+{
+	FRESULT res;
+	FATFS *fs;
+	DIR *dp;
+	BYTE c;
+#if FF_USE_LFN
+	BYTE ord = 0xFF, sum = 0xFF;
+#endif
+	DEF_NAMBUF
+
+
+	if (!bt) return FR_INVALID_OBJECT;
+	dp = &bt->dir;
+	bt->buf = 0;
+
+	/* Get logical drive */
+	res = find_volume(&path, &fs, FA_WRITE);
+	if (res == FR_OK) {
+		dp->obj.fs = fs;
+#ifdef LOSCFG_FS_FAT_VIRTUAL_PARTITION
+		if (ISVIRPART(fs)) {					/* Not supported on the virtual partition */
+			dp->obj.fs = 0;
+			LEAVE_FF(fs, FR_DENIED);
+		}
+#endif
+		INIT_NAMBUF(fs);
+		res = follow_path(dp, path);			/* Follow the path to the directory */
+		if (res == FR_OK && !(dp->fn[NSFLAG] & NS_NONAME)) {	/* It is not the origin directory itself */
+			if (dp->obj.attr & AM_DIR) {
+				dp->obj.sclust = ld_clust(fs, dp->dir);
+			} else {
+				res = FR_NO_DIR;
+			}
+		}
+		if (res == FR_NO_FILE) res = FR_NO_PATH;
+		if (res == FR_OK) {
+			bt->buf = (BYTE*)ff_memalloc(SS(fs));
+			if (!bt->buf) res = FR_NOT_ENOUGH_CORE;
+		}
+
+		/* Register the names in the directory to the filter and find end of the table */
+		if (res == FR_OK) {
+			mem_set(bt->flt, 0, sizeof bt->flt);
+			bt->eot = 0;
+			bt->rs = bt->cur = bt->re = 0;
+			res = dir_sdi(dp, 0);
+		}
+		while (res == FR_OK) {
+			res = move_window(fs, dp->sect);
+			if (res != FR_OK) break;
+			c = dp->dir[DIR_Name];
+			if (c == 0) break;					/* Reached to end of table */
+			bt->eot = dp->dptr + SZDIRE;
+			dp->obj.attr = dp->dir[DIR_Attr] & AM_MASK;
+#if FF_USE_LFN
+			if (c == DDEM || ((dp->obj.attr & AM_VOL) && dp->obj.attr != AM_LFN)) {	/* An entry without valid name */
+				ord = 0xFF;
+			} else if (dp->obj.attr == AM_LFN) {	/* An LFN entry is found */
+				if (c & LLEF) {
+					sum = dp->dir[LDIR_Chksum];
+					c &= (BYTE)~LLEF; ord = c;
+				}
+				ord = (c == ord && sum == dp->dir[LDIR_Chksum] && pick_lfn(fs->lfnbuf, dp->dir)) ? ord - 1 : 0xFF;
+			} else {							/* An SFN entry is found */
+				if (ord == 0 && sum == sum_sfn(dp->dir)) filter_name(bt, hash_lfn(fs->lfnbuf), 1);
+				filter_name(bt, hash_sfn(dp->dir), 1);
+				ord = 0xFF;
+			}
+#else
+			if (c != DDEM && !(dp->obj.attr & AM_VOL)) filter_name(bt, hash_sfn(dp->dir), 1);
+#endif
+			res = dir_next(dp, 0);
+		}
+		if (res == FR_NO_FILE) res = FR_OK;		/* Reached to end of the directory */
+#if FF_FS_LOCK != 0
+		if (res == FR_OK) {
+			if (dp->obj.sclust != 0) {
+				dp->obj.lockid = inc_lock(dp, 0);	/* Lock the sub directory */
+				if (!dp->obj.lockid) res = FR_TOO_MANY_OPEN_FILES;
+			} else {
+				dp->obj.lockid = 0;	/* Root directory need not to be locked */
+			}
+		}
+#endif
+		if (res == FR_OK) {
+			dp->obj.id = fs->id;				/* Validate the batch object */
+		} else if (bt->buf) {
+			ff_memfree(bt->buf);
+			bt->buf = 0;
+		}
+		FREE_NAMBUF();
+	}
+	if (res != FR_OK) dp->obj.fs = 0;		/* Invalidate the batch object if function faild */
+
+	LEAVE_FF(fs, res);
+}
+
+
+FRESULT f_batch_create (
+	FFBATCH* bt,		/* Pointer to the batch object */
+	const TCHAR* name,	/* Pointer to the file name (without path) */
+	const void* buff,	/* Pointer to the file data */
+	UINT btw			/* Size of the file data */
+)
+{
+	FRESULT res;
+	FATFS *fs;
+	DIR *dp = &bt->dir;
+	DWORD csz, ncl, scl = 0, tm;
+	QWORD sect;
+	UINT n, cc;
+	BYTE *dir;
+#if FF_USE_LFN
+	BYTE sn[12];
+#endif
+#ifndef __LITEOS_M__
+	UINT copy_ret;
+#endif
+	DEF_NAMBUF
+
+
+	res = validate(&dp->obj, &fs);			/* Check validity of the batch object */
+	if (res != FR_OK) LEAVE_FF(fs, res);
+	if (!name || (btw && !buff)) LEAVE_FF(fs, FR_INVALID_PARAMETER);
+	csz = (DWORD)fs->csize * SS(fs);		/* Bytes per cluster */
+	ncl = btw / csz + ((btw % csz) ? 1 : 0);	/* Number of clusters for the file */
+	if (ncl > FF_BATCH_CLST) LEAVE_FF(fs, FR_INVALID_PARAMETER);	/* Too large for a batch */
+
+	INIT_NAMBUF(fs);
+	res = create_name(dp, &name);			/* Get the file name */
+	if (res == FR_OK && (!(dp->fn[NSFLAG] & NS_LAST) || (dp->fn[NSFLAG] & (NS_DOT | NS_NONAME)))) {
+		res = FR_INVALID_NAME;				/* It is not a plain file name */
+	}
+
+	/* Check if the name collides with an object (scan the directory only if the filter hits) */
+	if (res == FR_OK) {
+#if FF_USE_LFN
+		if (filter_name(bt, hash_lfn(fs->lfnbuf), 0) || (!(dp->fn[NSFLAG] & NS_LOSS) && filter_name(bt, hash_sfn(dp->fn), 0))) {
+#else
+		if (filter_name(bt, hash_sfn(dp->fn), 0)) {
+#endif
+			res = dir_find(dp);
+			res = (res == FR_OK) ? FR_EXIST : (res == FR_NO_FILE) ? FR_OK : res;
+		}
+	}
+#if FF_USE_LFN
+	if (res == FR_OK && (dp->fn[NSFLAG] & NS_LOSS)) {	/* When LFN is out of 8.3 format, generate a numbered name */
+		mem_cpy(sn, dp->fn, 12);
+		dp->fn[NSFLAG] = NS_NOLFN;			/* Find only SFN */
+		for (n = 1; n < 100; n++) {
+			gen_numname(dp->fn, sn, fs->lfnbuf, n);	/* Generate a numbered name */
+			if (!filter_name(bt, hash_sfn(dp->fn), 0)) break;	/* Not collided */
+			res = dir_find(dp);				/* Check if the name collides with existing SFN */
+			if (res != FR_OK) break;
+		}
+		if (n == 100) res = FR_DENIED;		/* Abort if too many collisions */
+		if (res == FR_NO_FILE) res = FR_OK;
+		dp->fn[NSFLAG] = sn[NSFLAG];
+	}
+#endif
+
+	/* Take the clusters from the reserved run */
+	if (res == FR_OK && ncl > bt->re - bt->cur) {
+		res = flush_run(bt);
+		if (res == FR_OK) res = reserve_run(bt, ncl);
+	}
+	if (res == FR_OK && ncl) {
+		scl = bt->cur;
+
+		/* Write the file data to the contiguous sectors */
+		sect = clst2sect(fs, scl);
+		cc = btw / SS(fs);
+		if (cc && disk_write(fs->pdrv, (const BYTE*)buff, sect, cc) != RES_OK) res = FR_DISK_ERR;
+		if (res == FR_OK && btw % SS(fs)) {	/* Last partial sector */
+			mem_set(bt->buf, 0, SS(fs));
+#ifndef __LITEOS_M__
+			copy_ret = LOS_CopyToKernel(bt->buf, SS(fs), (const BYTE*)buff + cc * SS(fs), btw % SS(fs));
+			if (copy_ret != EOK) res = FR_INVALID_PARAMETER;
+#else
+			mem_cpy(bt->buf, (const BYTE*)buff + cc * SS(fs), btw % SS(fs));
+#endif
+			if (res == FR_OK && disk_write(fs->pdrv, bt->buf, sect + cc, 1) != RES_OK) res = FR_DISK_ERR;
+		}
+		if (res == FR_OK && scl + ncl < bt->re) {	/* Terminate the chain of the file, the rest of the run is left unreachable */
+			res = put_fat(fs, scl + ncl - 1, 0xFFFFFFFF);
+		}
+		if (res == FR_OK) {
+			bt->cur = scl + ncl;			/* Take the clusters from the run */
+		} else {
+			scl = 0;
+		}
+	}
+
+	/* Store the entry next to the last entry in use */
+	if (res == FR_OK) res = dir_store(dp, bt->eot);
+	if (res == FR_OK) {
+		dir = dp->dir;
+		tm = GET_FATTIME();
+		dir[DIR_Attr] = AM_ARC;
+		if (SYSTEM_TIME_ENABLE == time_status) {
+			st_dword(dir + DIR_CrtTime, tm);	/* Set created time */
+			st_dword(dir + DIR_ModTime, tm);	/* Set modified time */
+		}
+		st_clust(fs, dir, scl);				/* Set file allocation info */
+		st_dword(dir + DIR_FileSize, (DWORD)btw);
+		fs->wflag = 1;
+		bt->eot = dp->dptr + SZDIRE;
+#if FF_USE_LFN
+		filter_name(bt, hash_lfn(fs->lfnbuf), 1);
+#endif
+		filter_name(bt, hash_sfn(dp->fn), 1);
+	} else if (scl) {						/* Return the clusters to the run */
+		if (scl + ncl < bt->re) put_fat(fs, scl + ncl - 1, scl + ncl);	/* Rejoin the chain */
+		bt->cur = scl;
+	}
+	FREE_NAMBUF();
+
+	LEAVE_FF(fs, res);
+}
+
+
+FRESULT f_batch_commit (
+	FFBATCH* bt			/* Pointer to the batch object */
+)
+{
+	FRESULT res, rc;
+	FATFS *fs;
+
+
+	res = validate(&bt->dir.obj, &fs);		/* Check validity of the batch object */
+	if (res == FR_OK) {
+		res = flush_run(bt);				/* Release the unused part of the run */
+		rc = sync_fs(fs);					/* Flush the directory and FAT sectors */
+		if (res == FR_OK) res = rc;
+		ff_memfree(bt->buf);
+		bt->buf = 0;
+#if FF_FS_LOCK != 0
+		if (bt->dir.obj.lockid) {
+			rc = dec_lock(bt->dir.obj.fs, bt->dir.obj.lockid);	/* Decrement sub-directory open counter */
+			if (res == FR_OK) res = rc;
+		}
+#endif
+		bt->dir.obj.fs = 0;					/* Invalidate the batch object */
+	}
+
+	LEAVE_FF(fs, res);
+}
+
+#endif	/* FF_USE_BATCH */
+
+
+
+
+/*-----------------------------------------------------------------------*/
+/* Create a Directory                                                    */
+/*-----------------------------------------------------------------------*/
+
+static FRESULT mkdir_at (
+	DIR* base,				/* Directory the path is relative to (NULL:path with drive prefix) */
+	const TCHAR* path		/* Pointer to the directory path */
+)
+{
+	FRESULT res;
+	DIR dj;
+	FATFS *fs;
+#if FF_FS_REENTRANT
+	FATFS *fs_bak;
+#endif
+	BYTE *dir;
+	UINT n;
+	DWORD dcl, pcl, tm;
+	QWORD dsc;
+	FFOBJID sobj;
+	DEF_NAMBUF
+
+
+	/* Get logical drive */
+	res = base ? find_base(base, &fs, FA_WRITE) : find_volume(&path, &fs, FA_WRITE);
+	dj.obj.fs = fs;
+#if FF_FS_REENTRANT
+	fs_bak = fs;
+#endif
+	dj.obj.sclust = 0;
+	if (res == FR_OK) {
+#ifdef LOSCFG_FS_FAT_VIRTUAL_PARTITION
+#if FF_FS_REENTRANT
+		if (!base && ISCHILD(fs)) LEAVE_FF(fs_bak,FR_INVAILD_FATFS);
+#else
+		if (!base && ISCHILD(fs)) LEAVE_FF(fs,FR_INVAILD_FATFS);
+#endif
+		if (!base && ISVIRPART(fs)) {	/* (A base directory is already in the virtual partition) */
+			/* Check the virtual partition top directory, and match the virtual fs */
+			res = follow_virentry(&dj.obj,path);
+#if FF_FS_REENTRANT
+			if (res == FR_INT_ERR) LEAVE_FF(fs_bak,res);
+#else
+			if (res == FR_INT_ERR) LEAVE_FF(fs,res);
+#endif
+			if (res == FR_OK)
+				fs = dj.obj.fs;
+		}
+#endif
+		INIT_NAMBUF(fs);
+		res = follow_path_at(&dj, base, path);	/* Follow the file path */
+		if (res == FR_OK) res = FR_EXIST;		/* Name collision? */
+		if (FF_FS_RPATH && res == FR_NO_FILE && (dj.fn[NSFLAG] & NS_DOT)) {	/* Invalid name? */
+			res = FR_INVALID_NAME;
+		}
+		if (res == FR_NO_FILE) {				/* It is clear to create a new directory */
+			sobj.fs = fs;						/* New object id to create a new chain */
+#if FF_ALLOC_NEAR
+			alloc_near(fs, dj.obj.sclust ? clst2sect(fs, dj.obj.sclust) : fs->dirbase);
+#endif
+			dcl = create_chain(&sobj, 0);		/* Allocate a cluster for the new directory */
+			res = FR_OK;
+			if (dcl == 0) res = FR_NO_SPACE_LEFT;	/* No space to allocate a new cluster */
+			if (dcl == 1) res = FR_INT_ERR;			/* Any insanity? */
+			if (dcl == 0xFFFFFFFF) res = FR_DISK_ERR;	/* Disk error? */
+			if (res == FR_OK) res = sync_window(fs);	/* Flush FAT */
+			tm = GET_FATTIME();
+			if (res == FR_OK) {					/* Initialize the new directory table */
+				dsc = clst2sect(fs, dcl);
+#ifndef LOSCFG_FS_FAT_VIRTUAL_PARTITION
+				dir = fs->win;
+#else
+				dir = PARENTFS(fs)->win;
+#endif
+				mem_set(dir, 0, SS(fs));
+				mem_set(dir + DIR_Name, ' ', 11);	/* Create "." entry */
+				dir[DIR_Name] = '.';
+				dir[DIR_Attr] = AM_DIR;
+				if (SYSTEM_TIME_ENABLE == time_status) {
+					st_dword(dir + DIR_ModTime, tm);
+				} else if (SYSTEM_TIME_DISABLE == time_status) {
+					st_dword(dir + DIR_ModTime, 0);
+				}
+				st_clust(fs, dir, dcl);
+				mem_cpy(dir + SZDIRE, dir, SZDIRE);	/* Create ".." entry */
+				dir[SZDIRE + 1] = '.'; pcl = dj.obj.sclust;
+				if (fs->fs_type == FS_FAT32 && pcl == fs->dirbase) pcl = 0;
+				st_clust(fs, dir + SZDIRE, pcl);
+
+				for (n = fs->csize; n; n--) {	/* Write dot entries and clear following sectors */
+#ifndef LOSCFG_FS_FAT_VIRTUAL_PARTITION
+					fs->winsect = dsc++;
+					fs->wflag = 1;
+					res = sync_window(fs);
+					if (res != FR_OK) break;
+					mem_set(dir, 0, SS(fs));
+#else
+					PARENTFS(fs)->winsect = dsc++;
+					PARENTFS(fs)->wflag = 1;
+					res = sync_window(fs);
+					if (res != FR_OK) break;
+					mem_set(dir, 0, SS(fs));
+#endif
+				}
+			}
+			if (res == FR_OK) {
+				res = dir_register(&dj);	/* Register the object to the directoy */
+			}
+			if (res == FR_OK) {
+				dir = dj.dir;
+				if (SYSTEM_TIME_ENABLE == time_status) {
+					st_dword(dir + DIR_ModTime, tm);	/* Created time */
+				}
+				else if (SYSTEM_TIME_DISABLE == time_status)
+				{
+					st_dword(dir + DIR_ModTime, 0);		/* Created time */
+				}
+				st_clust(fs, dir, dcl);		/* Table start cluster */
+				dir[DIR_Attr] = AM_DIR;		/* Attribute */
+#ifndef LOSCFG_FS_FAT_VIRTUAL_PARTITION
+				fs->wflag = 1;
+#else
+				PARENTFS(fs)->wflag = 1;
+#endif
+				if (res == FR_OK) {
+					res = sync_fs(fs);
+				}
+			} else {
+				remove_chain(&dj.obj, dcl, 0);	/* Could not register, remove cluster chain */
+			}
+		}
+		FREE_NAMBUF();
+	}
+#if FF_FS_REENTRANT
+	LEAVE_FF(fs_bak, res);
+#else
+	LEAVE_FF(fs, res);
+#endif
+}
+
+
+FRESULT f_mkdir (
+	const TCHAR* path		/* Pointer to the directory path */
+)
+{
+	return mkdir_at(0, path);
+}
+
+
+#if FF_USE_OPENAT
+FRESULT f_mkdir_at (
+	DIR* dp,				/* Pointer to the open directory the name is relative to */
+	const TCHAR* name		/* Pointer to the directory name */
+)
+{
+	if (!dp) return FR_INVALID_OBJECT;
+	return mkdir_at(dp, name);
+}
+#endif
+
+
+#if FF_USE_MKDIRS
+/*-----------------------------------------------------------------------*/
+/* Create a Directory Path                                               */
+/*-----------------------------------------------------------------------*/
+/* The existing part of the path is followed once and the missing        */
+/* directories are created in sequence from there. Their tables are      */
+/* taken from a contiguous block of clusters and cleared at a time.      */
+
+static DWORD mkdirs_alloc (	/* >=2:Top of the block, 0:No contiguous block, 1:Internal error, 0xFFFFFFFF:Disk error */
+	FATFS* fs,			/* Filesystem object */
+	DWORD ncl			/* Number of clusters to allocate */
+)
+{
+	FFOBJID obj;
+	DWORD cl, cs, scl = 0, len = 0, n;
+
+
+	if (fs->free_clst < ncl) return 0;	/* No space (it also works when free_clst is not valid) */
+	obj.fs = fs;
+
+	/* Find a contiguous free block from the suggested cluster */
+	cl = fs->last_clst;
+	if (cl < 2 || cl >= fs->n_fatent) cl = 1;
+	for (n = fs->n_fatent - 2; n && len < ncl; n--) {
+		if (++cl >= fs->n_fatent) {		/* Check wrap-around */
+			cl = 2; len = 0;
+		}
+		cs = get_fat(&obj, cl);
+		if (cs == 1 || cs == 0xFFFFFFFF) return cs;
+		if (cs == 0) {					/* A free cluster */
+			if (len++ == 0) scl = cl;
+		} else {
+			len = 0;
+		}
+	}
+	if (len < ncl) return 0;
+
+	/* Each cluster in the block is a single cluster directory table */
+	for (cl = scl; cl < scl + ncl; cl++) {
+		if (put_fat(fs, cl, 0xFFFFFFFF) != FR_OK) return 0xFFFFFFFF;
+	}
+	if (fs->free_clst <= fs->n_fatent - 2) fs->free_clst -= ncl;	/* Update FSINFO */
+	fs->last_clst = scl + ncl - 1;
+	fs->fsi_flag |= 1;
+	return scl;
+}
+
+
+FRESULT f_mkdirs (
+	const TCHAR* path		/* Pointer to the directory path */
+)
+{
+	FRESULT res;
+	DIR dj;
+	FATFS *fs, *wfs;
+#if FF_FS_REENTRANT
+	FATFS *fs_bak;
+#endif
+	BYTE *dir, ns;
+	const TCHAR *seg, *p;
+	DWORD nd, i, scl, dcl, pcl, tm;
+	FFOBJID sobj;
+	DEF_NAMBUF
+
+
+	/* Get logical drive */
+	res = find_volume(&path, &fs, FA_WRITE);
+	dj.obj.fs = fs;
+#if FF_FS_REENTRANT
+	fs_bak = fs;
+#endif
+	dj.obj.sclust = 0;
+	if (res == FR_OK) {
+#ifdef LOSCFG_FS_FAT_VIRTUAL_PARTITION
+#if FF_FS_REENTRANT
+		if (ISCHILD(fs)) LEAVE_FF(fs_bak,FR_INVAILD_FATFS);
+#else
+		if (ISCHILD(fs)) LEAVE_FF(fs,FR_INVAILD_FATFS);
+#endif
+		if (ISVIRPART(fs)) {
+			/* Check the virtual partition top directory, and match the virtual fs */
+			res = follow_virentry(&dj.obj,path);
+#if FF_FS_REENTRANT
+			if (res == FR_INT_ERR) LEAVE_FF(fs_bak,res);
+#else
+			if (res == FR_INT_ERR) LEAVE_FF(fs,res);
+#endif
+			if (res == FR_OK)
+				fs = dj.obj.fs;
+		}
+		wfs = PARENTFS(fs);			/* Window of the directory entries */
+#else
+		wfs = fs;
+#endif
+		INIT_NAMBUF(fs);
+
+		/* Follow the existing part of the path */
+#if FF_FS_RPATH != 0
+		if (*path != '/' && *path != '\\') {	/* Without heading separator */
+			dj.obj.sclust = fs->cdir;			/* Start from current directory */
+		} else
+#endif
+		{										/* With heading separator */
+			while (*path == '/' || *path == '\\') path++;	/* Strip heading separator */
+			dj.obj.sclust = 0;					/* Start from root directory */
+		}
+		seg = path; nd = 0;
+		while ((UINT)*path >= ' ') {
+			seg = path;
+			res = create_name(&dj, &path);	/* Get a segment name of the path */
+			if (res != FR_OK) break;
+			res = dir_find(&dj);			/* Find an object with the segment name */
+			ns = dj.fn[NSFLAG];
+			if (res == FR_NO_FILE && FF_FS_RPATH && (ns & NS_DOT)) {	/* If dot entry is not exist, stay there */
+				res = FR_OK;
+			} else {
+				if (res != FR_OK) break;
+				if (!(dj.obj.attr & AM_DIR)) {	/* It is not a sub-directory */
+					res = (ns & NS_LAST) ? FR_EXIST : FR_NO_PATH; break;
+				}
+				dj.obj.sclust = ld_clust(wfs, wfs->win + dj.dptr % SS(wfs));	/* Open next directory */
+			}
+			if (ns & NS_LAST) break;		/* Last segment matched */
+		}
+
+		/* Count the directories to be created */
+		if (res == FR_NO_FILE) {
+			for (p = seg, res = FR_OK; res == FR_OK; ) {
+				res = create_name(&dj, &p);
+				if (res != FR_OK) break;
+				if (dj.fn[NSFLAG] & NS_DOT) res = FR_INVALID_NAME;	/* Dot entry cannot be created */
+				nd++;
+				if (dj.fn[NSFLAG] & NS_LAST) break;
+			}
+		}
+
+		/* Create the directories in a contiguous block of clusters */
+		if (res == FR_OK && nd > 0) {
+			tm = GET_FATTIME();
+			scl = 0;
+#ifdef LOSCFG_FS_FAT_VIRTUAL_PARTITION
+			if (!ISVIRPART(fs))					/* (Clusters of a virtual partition are given by create_chain()) */
+#endif
+			if (nd > 1) {
+#if FF_ALLOC_NEAR
+				alloc_near(fs, dj.obj.sclust ? clst2sect(fs, dj.obj.sclust) : fs->dirbase);
+#endif
+				scl = mkdirs_alloc(fs, nd);
+				if (scl == 1) res = FR_INT_ERR;
+				if (scl == 0xFFFFFFFF) res = FR_DISK_ERR;
+				if (res == FR_OK && scl >= 2) res = dir_clear(fs, scl, nd);	/* Clear the tables at a time */
+			}
+			for (i = 0; res == FR_OK && i < nd; i++) {
+				res = create_name(&dj, &seg);	/* Get the name of the new directory */
+				if (res != FR_OK) break;
+				if (scl >= 2) {					/* Take a cluster from the block */
+					dcl = scl + i;
+				} else {						/* Allocate a cluster for the new directory */
+					sobj.fs = fs;
+#if FF_ALLOC_NEAR
+					alloc_near(fs, dj.obj.sclust ? clst2sect(fs, dj.obj.sclust) : fs->dirbase);
+#endif
+					dcl = create_chain(&sobj, 0);
+					if (dcl == 0) res = FR_NO_SPACE_LEFT;
+					if (dcl == 1) res = FR_INT_ERR;
+					if (dcl == 0xFFFFFFFF) res = FR_DISK_ERR;
+					if (res == FR_OK) res = dir_clear(fs, dcl, 1);
+					if (res != FR_OK) break;
+				}
+				res = sync_window(fs);
+				if (res == FR_OK) {				/* Put dot entries on the cleared table */
+					dir = wfs->win;
+					mem_set(dir, 0, SS(fs));
+					mem_set(dir + DIR_Name, ' ', 11);	/* Create "." entry */
+					dir[DIR_Name] = '.';
+					dir[DIR_Attr] = AM_DIR;
+					if (SYSTEM_TIME_ENABLE == time_status) {
+						st_dword(dir + DIR_ModTime, tm);
+					} else if (SYSTEM_TIME_DISABLE == time_status) {
+						st_dword(dir + DIR_ModTime, 0);
+					}
+					st_clust(fs, dir, dcl);
+					mem_cpy(dir + SZDIRE, dir, SZDIRE);	/* Create ".." entry */
+					dir[SZDIRE + 1] = '.'; pcl = dj.obj.sclust;
+					if (fs->fs_type == FS_FAT32 && pcl == fs->dirbase) pcl = 0;
+					st_clust(fs, dir + SZDIRE, pcl);
+					wfs->winsect = clst2sect(fs, dcl);
+					wfs->wflag = 1;
+					res = dir_register(&dj);	/* Register the object to the parent directoy */
+				}
+				if (res == FR_OK) {
+					dir = dj.dir;
+					if (SYSTEM_TIME_ENABLE == time_status) {
+						st_dword(dir + DIR_ModTime, tm);	/* Created time */
+					} else if (SYSTEM_TIME_DISABLE == time_status) {
+						st_dword(dir + DIR_ModTime, 0);		/* Created time */
+					}
+					st_clust(fs, dir, dcl);		/* Table start cluster */
+					dir[DIR_Attr] = AM_DIR;		/* Attribute */
+					wfs->wflag = 1;
+					dj.obj.sclust = dcl;		/* Get into the new directory */
+				} else {
+					if (scl < 2) remove_chain(&dj.obj, dcl, 0);	/* Could not register, remove cluster chain */
+					break;
+				}
+			}
+			if (scl >= 2) {						/* Release the clusters not used */
+				for ( ; i < nd; i++) {
+					if (put_fat(fs, scl + i, 0) != FR_OK) break;
+					if (fs->free_clst < fs->n_fatent - 2) fs->free_clst++;
+					fs->fsi_flag |= 1;
+				}
+			}
+			if (res == FR_OK) res = sync_fs(fs);
+		}
+		FREE_NAMBUF();
+	}
+#if FF_FS_REENTRANT
+	LEAVE_FF(fs_bak, res);
+#else
+	LEAVE_FF(fs, res);
+#endif
+}
+#endif	/* FF_USE_MKDIRS */
+
+/*-----------------------------------------------------------------------*/
+/* Rename a File/Directory                                               */
+/*-----------------------------------------------------------------------*/
+
+FRESULT f_rename (
+	const TCHAR* path_old,	/* Pointer to the object name to be renamed */
+	const TCHAR* path_new	/* Pointer to the new name */
+)
+{
+	FRESULT res;
+	DIR djo, djn;
+	FATFS *fs;
+#if FF_FS_REENTRANT
+	FATFS *fs_bak;
+#endif
+	BYTE buf[SZDIRE], *dir;
+	QWORD dw;
+#ifdef LOSCFG_FS_FAT_VIRTUAL_PARTITION
+	DWORD rtclst = 0;
+	DWORD st_bak = 0;
+	CHWALK cw;
+#endif
 
 	DEF_NAMBUF
 
@@ -4787,6 +7838,7 @@ FRESULT f_rename (
 		if (res == FR_OK && ISVIRPART(fs)) {
 			djo.atrootdir = 0;rtclst = 2;
 			st_bak = PARENTFS(djo.obj.fs)->winsect;
+			chain_init(&cw, fs, rtclst);
 			/* Follow the root directory cluster chain */
 			for (;;) {
 #if FF_FS_REENTRANT
@@ -4806,6 +7858,7 @@ FRESULT f_rename (
 					djo.atrootdir = 1;
 				}
 				rtclst = get_fat(&(djo.obj),rtclst);
+				if (rtclst >= 2 && rtclst < fs->n_fatent && chain_chk(&cw, rtclst)) rtclst = 1;	/* Broken chain? */
 			}
 			/* If current item is on rootdir clust chain */
 			if (djo.atrootdir == 1) {
@@ -4836,44 +7889,150 @@ FRESULT f_rename (
 					mem_cpy(dir + 13, buf + 13, SZDIRE - 13);
 					dir[DIR_Attr] = buf[DIR_Attr];
 					if (!(dir[DIR_Attr] & AM_DIR)) dir[DIR_Attr] |= AM_ARC;	/* Set archive attribute if it is a file */
+#if FF_FS_RPATH >= 2 && FF_CWD_CACHE
+					if (dir[DIR_Attr] & AM_DIR) fs->cwdclst = 0xFFFFFFFF;	/* Cached path of current directory can be changed */
+#endif
 #ifndef LOSCFG_FS_FAT_VIRTUAL_PARTITION
 					fs->wflag = 1;
 #else
-					PARENTFS(fs)->wflag = 1;
+					PARENTFS(fs)->wflag = 1;
+#endif
+					if ((dir[DIR_Attr] & AM_DIR) && djo.obj.sclust != djn.obj.sclust) {	/* Update .. entry in the sub-directory if needed */
+						dw = clst2sect(fs, ld_clust(fs, dir));
+						if (!dw) {
+							res = FR_INT_ERR;
+						} else {
+/* Start of critical section where an interruption can cause a cross-link */
+#ifndef LOSCFG_FS_FAT_VIRTUAL_PARTITION
+							res = move_window(fs, dw);
+							dir = fs->win + SZDIRE * 1;	/* Ptr to .. entry */
+							if (res == FR_OK && dir[1] == '.') {
+								st_clust(fs, dir, djn.obj.sclust);
+							fs->wflag = 1;
+#else
+							res = move_window(fs, dw);
+							dir = PARENTFS(fs)->win + SZDIRE * 1;	/* Ptr to .. entry */
+							if (res == FR_OK && dir[1] == '.') {
+								st_clust(fs, dir, djn.obj.sclust);
+								PARENTFS(fs)->wflag = 1;
+#endif
+							}
+						}
+					}
+				}
+			}
+			if (res == FR_OK) {
+				res = dir_remove(&djo);		/* Remove old entry */
+				if (res == FR_OK) {
+					res = sync_fs(fs);
+				}
+			}
+/* End of the critical section */
+		}
+		FREE_NAMBUF();
+	}
+#if FF_FS_REENTRANT
+	LEAVE_FF(fs_bak, res);
+#else
+	LEAVE_FF(fs, res);
+#endif
+}
+
+
+
+#if FF_USE_REPLACE
+/*-----------------------------------------------------------------------*/
+/* Replace a File with Another File                                      */
+/*-----------------------------------------------------------------------*/
+
+FRESULT f_replace (
+	const TCHAR* path_src,	/* Pointer to the file to replace the target with */
+	const TCHAR* path_dst,	/* Pointer to the file to be replaced */
+	BYTE opt				/* Options (RP_DEFER) */
+)
+{
+	FRESULT res;
+	DIR djo, djn;
+	FATFS *fs;
+#if FF_FS_REENTRANT
+	FATFS *fs_bak;
+#endif
+	BYTE buf[SZDIRE], *dir;
+	DWORD ocl = 0;
+	DEF_NAMBUF
+
+
+	get_ldnumber(&path_dst);						/* Snip the drive number of the target off */
+	res = find_volume(&path_src, &fs, FA_WRITE);	/* Get logical drive of the source file */
+#if FF_FS_REENTRANT
+	fs_bak = fs;
+#endif
+	if (res == FR_OK) {
+		djo.obj.fs = fs;
+#ifdef LOSCFG_FS_FAT_VIRTUAL_PARTITION
+		if (ISCHILD(fs)) res = FR_INVAILD_FATFS;
+		if (res == FR_OK && ISVIRPART(fs)) {
+			/* Check the virtual partition top directory, and match the virtual fs */
+			res = follow_virentry(&djo.obj, path_src);
+			if (res == FR_OK) fs = djo.obj.fs;
+			if (res != FR_INT_ERR) res = FR_OK;
+		}
+		if (res == FR_OK) {
+#endif
+		INIT_NAMBUF(fs);
+		res = follow_path(&djo, path_src);		/* Check the source file */
+		if (res == FR_OK && (djo.fn[NSFLAG] & (NS_DOT | NS_NONAME))) res = FR_INVALID_NAME;
+		if (res == FR_OK && (djo.obj.attr & AM_DIR)) res = FR_DENIED;	/* A directory cannot be the source */
+#if FF_FS_LOCK != 0
+		if (res == FR_OK) res = chk_lock(&djo, 2);
+#endif
+		if (res == FR_OK) {
+			mem_cpy(buf, djo.dir, SZDIRE);		/* Save directory entry of the source file */
+			mem_cpy(&djn, &djo, sizeof (DIR));	/* Duplicate the directory object */
+			res = follow_path(&djn, path_dst);	/* Check the target file */
+			if (res == FR_OK) {					/* The target exists */
+				if (djn.obj.sclust == djo.obj.sclust && djn.dptr == djo.dptr) {	/* Replace the file with itself? */
+					FREE_NAMBUF();
+#if FF_FS_REENTRANT
+					LEAVE_FF(fs_bak, FR_OK);
+#else
+					LEAVE_FF(fs, FR_OK);
 #endif
-					if ((dir[DIR_Attr] & AM_DIR) && djo.obj.sclust != djn.obj.sclust) {	/* Update .. entry in the sub-directory if needed */
-						dw = clst2sect(fs, ld_clust(fs, dir));
-						if (!dw) {
-							res = FR_INT_ERR;
-						} else {
-/* Start of critical section where an interruption can cause a cross-link */
+				}
+				if (djn.fn[NSFLAG] & (NS_DOT | NS_NONAME)) res = FR_INVALID_NAME;
+				else if (djn.obj.attr & (AM_DIR | AM_RDO)) res = FR_DENIED;	/* Only a writable file can be replaced */
+#if FF_FS_LOCK != 0
+				if (res == FR_OK) res = chk_lock(&djn, 2);
+#endif
+				if (res == FR_OK) ocl = ld_clust(fs, djn.dir);	/* Chain of the old content */
+			} else if (res == FR_NO_FILE) {		/* The target does not exist, register it as f_rename() does */
+				res = dir_register(&djn);
+			}
+			if (res == FR_OK) {		/* Point the target entry at the content of the source file */
+/* Start of critical section where an interruption can lose the old content or leave both entries */
+				dir = djn.dir;
+				mem_cpy(dir + 13, buf + 13, SZDIRE - 13);
+				dir[DIR_Attr] = buf[DIR_Attr] | AM_ARC;
 #ifndef LOSCFG_FS_FAT_VIRTUAL_PARTITION
-							res = move_window(fs, dw);
-							dir = fs->win + SZDIRE * 1;	/* Ptr to .. entry */
-							if (res == FR_OK && dir[1] == '.') {
-								st_clust(fs, dir, djn.obj.sclust);
-							fs->wflag = 1;
+				fs->wflag = 1;
 #else
-							res = move_window(fs, dw);
-							dir = PARENTFS(fs)->win + SZDIRE * 1;	/* Ptr to .. entry */
-							if (res == FR_OK && dir[1] == '.') {
-								st_clust(fs, dir, djn.obj.sclust);
-								PARENTFS(fs)->wflag = 1;
+				PARENTFS(fs)->wflag = 1;
 #endif
-							}
-						}
-					}
+				res = dir_remove(&djo);		/* Remove the source entry (in the same window if they share a sector) */
+				if (res == FR_OK && ocl && !(opt & RP_DEFER)) {
+					res = remove_chain(&djn.obj, ocl, 0);	/* Free the old content */
 				}
-			}
-			if (res == FR_OK) {
-				res = dir_remove(&djo);		/* Remove old entry */
-				if (res == FR_OK) {
-					res = sync_fs(fs);
+				if (res == FR_OK) res = sync_fs(fs);	/* Commit the directory and the FAT at once */
+				if (res == FR_OK && ocl && (opt & RP_DEFER)) {
+					res = remove_chain(&djn.obj, ocl, 0);	/* Free the old content after the commit (written back at next sync) */
 				}
-			}
 /* End of the critical section */
+			}
 		}
 		FREE_NAMBUF();
+#ifdef LOSCFG_FS_FAT_VIRTUAL_PARTITION
+		}
+#endif
 	}
 #if FF_FS_REENTRANT
 	LEAVE_FF(fs_bak, res);
@@ -4881,6 +8040,7 @@ FRESULT f_rename (
 	LEAVE_FF(fs, res);
 #endif
 }
+#endif	/* FF_USE_REPLACE */
 
 #endif /* !FF_FS_READONLY */
 #endif /* FF_FS_MINIMIZE == 0 */
@@ -5138,7 +8298,7 @@ FRESULT f_setlabel (
 			if (res == FR_NO_FILE) {
 				res = FR_OK;
 				if (di != 0) {	/* Create a volume label entry */
-					res = dir_alloc(&dj, 1);	/* Allocate an entry */
+					res = dir_alloc(&dj, 1, 0);	/* Allocate an entry */
 					if (res == FR_OK) {
 						mem_set(dj.dir, 0, SZDIRE);	/* Clean the entry */
 						dj.dir[DIR_Attr] = AM_VOL;	/* Create volume label entry */
@@ -5186,12 +8346,19 @@ FRESULT f_expand (
 	count = 0;
 	if (fp->obj.sclust != 0) {
 	    count = get_clustinfo(fp, &fclust);
+	    if (count == 0xFFFFFFFF) LEAVE_FF(fs, FR_INT_ERR);
 	}
 	if (offset + fsz <= n * count) LEAVE_FF(fs, FR_OK);
 
 	exsz = offset + fsz - n * count;
 	tcl = (DWORD)(exsz / n) + ((exsz & (n - 1)) ? 1 : 0);	/* Number of clusters required */
+#if FF_ALLOC_ZONE
+	alloc_zone(fp, offset + fsz);	/* Start to find in the zone of the expanded size */
+#endif
 	stcl = fs->last_clst; lclst = 0;
+#if FF_FS_REENTRANT && FF_FS_MAXHOLD
+	hold_start(fs, HS_EXPAND);	/* The chain built so far is terminated at each yield point */
+#endif
 
 #ifdef LOSCFG_FS_FAT_VIRTUAL_PARTITION
 	if (ISVIRPART(fs)) {
@@ -5221,6 +8388,12 @@ FRESULT f_expand (
 			}
 			/* Move the current cluster to the next one */
 			if (++clst >= fs->st_clst + fs->ct_clst) clst = fs->st_clst;
+#if FF_FS_REENTRANT && FF_FS_MAXHOLD
+			if (hold_due(fs)) {	/* Yield the volume if held too long */
+				if (clstbak != 0 && (res = put_fat(fs, clstbak, 0xFFFFFFFF)) != FR_OK) break;	/* The last cluster found is not to be taken while yielding */
+				if ((res = hold_yield(fs)) != FR_OK) break;
+			}
+#endif
 		}
 	} else
 #endif
@@ -5250,8 +8423,17 @@ FRESULT f_expand (
 			}
 			/* Move the current cluster to the next one */
 			if (++clst >= fs->n_fatent) clst = 2;
+#if FF_FS_REENTRANT && FF_FS_MAXHOLD
+			if (hold_due(fs)) {	/* Yield the volume if held too long */
+				if (clstbak != 0 && (res = put_fat(fs, clstbak, 0xFFFFFFFF)) != FR_OK) break;	/* The last cluster found is not to be taken while yielding */
+				if ((res = hold_yield(fs)) != FR_OK) break;
+			}
+#endif
 		}
 	}
+#if FF_FS_REENTRANT && FF_FS_MAXHOLD
+	hold_end(fs);
+#endif
 
 	if (res == FR_OK) {
 #ifndef LOSCFG_FS_FAT_VIRTUAL_PARTITION
@@ -5296,18 +8478,14 @@ FRESULT f_expand (
 			}
 		}
 #endif
-	} else {	/* Reached error, remove the chain which built before */
+	} else if (res != FR_TIMEOUT && res != FR_INVALID_OBJECT) {	/* Reached error, free the clusters linked so far unless the volume has been lost while yielding */
 		clst = scl;
-		for (;;) {
-			n = get_fat(&fp->obj, clst);
-			if (n == 1 || n == 0) { res = FR_INT_ERR; break; }
-			if (n == 0xFFFFFFFF) { res = FR_DISK_ERR; break; }
-			res = put_fat(fs, clst, 0);
-			if (res != FR_OK) break;
-			if (n == 0x0FFFFFFF) break;	/* If the current cluster is the last cluster ,the finish this operation */
+		while (clstbak != 0) {
+			n = (clst == clstbak) ? 0 : get_fat(&fp->obj, clst);	/* Next cluster of the chain built so far */
+			if (n == 1 || n == 0xFFFFFFFF) break;
+			if (put_fat(fs, clst, 0) != FR_OK || clst == clstbak) break;	/* (free_clst has not been decreased for them) */
 			clst = n;
 		}
-		res = put_fat(fs, fclust, 0xFFFFFFFF);
 	}
 
 	LEAVE_FF(fs, res);
@@ -5317,6 +8495,450 @@ FRESULT f_expand (
 
 
 
+
+#if FF_USE_COLLAPSE && !FF_FS_READONLY
+/*-----------------------------------------------------------------------*/
+/* Remove Leading Clusters of a File                                     */
+/*-----------------------------------------------------------------------*/
+
+FRESULT f_collapse_head (
+	FIL* fp,		/* Pointer to the file object */
+	FSIZE_t bytes	/* Number of bytes to be removed from top of the file (multiple of the cluster size) */
+)
+{
+	FRESULT res;
+	FATFS *fs;
+	DWORD n, bcs, scl, pcl, clst;
+	CHWALK cw;
+	BYTE *dir;
+
+
+	res = validate(&fp->obj, &fs);	/* Check validity of the file object */
+	if (res != FR_OK || (res = (FRESULT)fp->err) != FR_OK) LEAVE_FF(fs, res);
+	if (!(fp->flag & FA_WRITE)) LEAVE_FF(fs, FR_NO_EPERM);	/* Check access mode */
+
+	bcs = (DWORD)fs->csize * SS(fs);	/* Cluster size */
+	if (bytes % bcs || bytes > fp->obj.objsize) LEAVE_FF(fs, FR_INVALID_PARAMETER);
+	if (bytes == 0) LEAVE_FF(fs, FR_OK);
+
+#if !FF_FS_TINY
+	if (fp->flag & FA_DIRTY) {	/* Write-back cached data before its cluster can be freed */
+		if (disk_write(fs->pdrv, fp->buf, fp->sect, 1) != RES_OK) ABORT(fs, FR_DISK_ERR);
+		fp->flag &= (BYTE)~FA_DIRTY;
+	}
+#endif
+
+	/* Find the last cluster to be removed and the new top of the chain */
+	scl = clst = fp->obj.sclust;
+	pcl = 0;
+	chain_init(&cw, fs, clst);
+	for (n = (DWORD)(bytes / bcs); n; n--) {
+		if (clst < 2 || clst >= fs->n_fatent) ABORT(fs, FR_INT_ERR);	/* The chain is shorter than the file size */
+		pcl = clst;
+		clst = get_fat(&fp->obj, clst);
+		if (clst == 1) ABORT(fs, FR_INT_ERR);
+		if (clst == 0xFFFFFFFF) ABORT(fs, FR_DISK_ERR);
+		if (clst >= 2 && clst < fs->n_fatent && chain_chk(&cw, clst)) ABORT(fs, FR_INT_ERR);	/* Broken chain? */
+	}
+	if (clst >= fs->n_fatent) clst = 0;	/* The entire chain is removed */
+	if (clst == 0 && bytes < fp->obj.objsize) ABORT(fs, FR_INT_ERR);
+
+	/* Move the top of the file in the directory entry first, an interruption after this can leave only lost clusters */
+	res = move_window(fs, fp->dir_sect);
+	if (res == FR_OK) {
+		dir = fp->dir_ptr;
+		st_clust(fs, dir, clst);
+		st_dword(dir + DIR_FileSize, (DWORD)(fp->obj.objsize - bytes));
+		dir[DIR_Attr] |= AM_ARC;
+#ifndef LOSCFG_FS_FAT_VIRTUAL_PARTITION
+		fs->wflag = 1;
+#else
+		PARENTFS(fs)->wflag = 1;
+#endif
+		if (clst != 0) res = put_fat(fs, pcl, 0xFFFFFFFF);	/* Terminate the head at the last cluster removed */
+	}
+	if (res == FR_OK) {
+#if FF_FS_REENTRANT && FF_FS_MAXHOLD
+		hold_start(fs, HS_REMOVE);	/* The head is no longer reachable from the file */
+#endif
+		res = remove_chain(&fp->obj, scl, 0);	/* Free the head */
+#if FF_FS_REENTRANT && FF_FS_MAXHOLD
+		hold_end(fs);
+#endif
+	}
+	if (res == FR_OK) res = sync_fs(fs);
+	if (res != FR_OK) ABORT(fs, res);
+
+	/* Move the file object to the new top */
+	fp->obj.sclust = clst;
+	fp->obj.objsize -= bytes;
+	if (fp->fptr > bytes) {		/* The file pointer stays at the same cluster and sector */
+		fp->fptr -= bytes;
+	} else {					/* The file pointer was in the head, rewind it */
+		fp->fptr = 0;
+		fp->clust = clst;
+#if !FF_FS_TINY
+		fp->sect = 0;			/* Invalidate the data read-ahead */
+#endif
+	}
+#if FF_USE_FASTSEEK
+	fp->cltbl = 0;				/* The link map is no longer valid */
+#endif
+#if FF_USE_STREAM
+	fp->st_size = (fp->st_size > bytes) ? fp->st_size - bytes : 0;
+#endif
+
+	LEAVE_FF(fs, FR_OK);
+}
+
+#endif /* FF_USE_COLLAPSE && !FF_FS_READONLY */
+
+
+
+
+#if FF_USE_RING && !FF_FS_READONLY && !FF_FS_TINY
+/*-----------------------------------------------------------------------*/
+/* Ring File                                                             */
+/*-----------------------------------------------------------------------*/
+/* A ring file is allocated in contiguous clusters. The first sector is  */
+/* the header and the data area follows it, so that the sector of a data */
+/* offset is given without following the FAT. Partial sectors are put   */
+/* via the sector buffer of the file object.                             */
+
+static FRESULT ring_alloc (	/* FR_OK(0):succeeded, FR_DENIED:no contiguous free clusters, !=0:error */
+	FIL* fp,			/* File object with no cluster */
+	DWORD ncl			/* Number of clusters to allocate */
+)
+{
+	FRESULT res = FR_OK;
+	FATFS *fs = fp->obj.fs;
+	DWORD cl, cs, scl = 0, len = 0, n;
+
+
+	if (fs->free_clst < ncl) return FR_DENIED;	/* No space (it also works when free_clst is not valid) */
+
+	/* Find a contiguous free block from the suggested cluster */
+	cl = fs->last_clst;
+	if (cl < 2 || cl >= fs->n_fatent) cl = 1;
+#if FF_FS_REENTRANT && FF_FS_MAXHOLD
+	hold_start(fs, HS_EXPAND);
+#endif
+	for (n = fs->n_fatent - 2; n && len < ncl; n--) {
+		if (++cl >= fs->n_fatent) {		/* Check wrap-around */
+			cl = 2; len = 0;
+		}
+		cs = get_fat(&fp->obj, cl);
+		if (cs == 1) { res = FR_INT_ERR; break; }
+		if (cs == 0xFFFFFFFF) { res = FR_DISK_ERR; break; }
+		if (cs == 0) {					/* A free cluster */
+			if (len++ == 0) scl = cl;
+		} else {
+			len = 0;
+		}
+#if FF_FS_REENTRANT && FF_FS_MAXHOLD
+		if (hold_due(fs)) {	/* Yield the volume if held too long */
+			if ((res = hold_yield(fs)) != FR_OK) break;	/* The volume has been lost while yielding */
+			len = 0;	/* The free clusters counted so far can have been taken while yielding */
+		}
+#endif
+	}
+	if (res == FR_OK && len < ncl) res = FR_DENIED;
+
+	/* Allocate the block as a chain */
+	for (cl = scl; res == FR_OK && cl < scl + ncl; cl++) {
+		res = put_fat(fs, cl, (cl + 1 < scl + ncl) ? cl + 1 : 0xFFFFFFFF);
+	}
+#if FF_FS_REENTRANT && FF_FS_MAXHOLD
+	hold_end(fs);
+#endif
+	if (res == FR_OK) {
+		if (fs->free_clst <= fs->n_fatent - 2) fs->free_clst -= ncl;	/* Update FSINFO */
+		fs->last_clst = scl + ncl - 1;
+		fs->fsi_flag |= 1;
+		fp->obj.sclust = scl;
+	}
+	return res;
+}
+
+
+static FRESULT ring_fill (	/* FR_OK(0):succeeded, !=0:error */
+	FFRING* rp,			/* Ring file object */
+	QWORD sect,			/* Sector to be loaded into the buffer */
+	int rd				/* 0:Old data in the sector is not needed */
+)
+{
+	FIL *fp = &rp->fil;
+	FATFS *fs = fp->obj.fs;
+
+
+	if (fp->sect != sect) {
+		if (fp->flag & FA_DIRTY) {	/* Write-back dirty sector */
+			if (disk_write(fs->pdrv, fp->buf, fp->sect, 1) != RES_OK) return FR_DISK_ERR;
+			fp->flag &= (BYTE)~FA_DIRTY;
+		}
+		if (rd && disk_read(fs->pdrv, fp->buf, sect, 1) != RES_OK) {
+			fp->sect = 0;
+			return FR_DISK_ERR;
+		}
+		fp->sect = sect;
+	}
+	return FR_OK;
+}
+
+
+static FRESULT ring_save (	/* FR_OK(0):succeeded, !=0:error */
+	FFRING* rp			/* Ring file object */
+)
+{
+	FIL *fp = &rp->fil;
+	FATFS *fs = fp->obj.fs;
+	QWORD sect = rp->sect - 1;	/* Header sector */
+
+
+	if (ring_fill(rp, sect, 0) != FR_OK) return FR_DISK_ERR;	/* Flush the data and take the buffer for the header */
+	mem_set(fp->buf, 0, SS(fs));
+	st_dword(fp->buf + RG_Sig, 0x474E4952);	/* "RING" */
+	st_dword(fp->buf + RG_Size, rp->size);
+	st_dword(fp->buf + RG_Head, rp->head);
+	st_dword(fp->buf + RG_Used, rp->used);
+	if (disk_write(fs->pdrv, fp->buf, sect, 1) != RES_OK) return FR_DISK_ERR;
+	if (disk_ioctl(fs->pdrv, CTRL_SYNC, 0) != RES_OK) return FR_DISK_ERR;
+	return FR_OK;
+}
+
+
+static FRESULT ring_init (	/* FR_OK(0):succeeded, !=0:error */
+	FFRING* rp,			/* Ring file object with the file opened */
+	DWORD size			/* Size of the data area of a new ring file (0:open existing ring file) */
+)
+{
+	FRESULT res;
+	FATFS *fs;
+	FIL *fp = &rp->fil;
+	DWORD bcs, ncl, cl, nxt;
+
+
+	res = validate(&fp->obj, &fs);
+	if (res != FR_OK) LEAVE_FF(fs, res);
+	bcs = (DWORD)fs->csize * SS(fs);	/* Cluster size */
+	fp->sect = 0;
+
+	if (fp->obj.sclust == 0) {		/* Create the ring in the empty file */
+		if (size == 0 || fp->obj.objsize != 0) LEAVE_FF(fs, FR_DENIED);
+		if (size > 0xFFFFFFFF - SS(fs) * 2) LEAVE_FF(fs, FR_INVALID_PARAMETER);
+		size = (size + SS(fs) - 1) / SS(fs) * SS(fs);	/* Round up to the sector boundary */
+		ncl = (DWORD)(((QWORD)SS(fs) + size + bcs - 1) / bcs);
+		res = ring_alloc(fp, ncl);
+		if (res != FR_OK) LEAVE_FF(fs, res);
+		fp->obj.objsize = SS(fs) + size;
+		fp->flag |= FA_MODIFIED;		/* The directory entry is updated by the caller */
+		rp->size = size;
+		rp->head = rp->used = 0;
+		rp->sect = clst2sect(fs, fp->obj.sclust) + 1;
+		res = ring_save(rp);
+	} else {						/* Take the state of existing ring file */
+		rp->sect = clst2sect(fs, fp->obj.sclust) + 1;
+		if (rp->sect == 1) LEAVE_FF(fs, FR_INT_ERR);
+		res = ring_fill(rp, rp->sect - 1, 1);
+		if (res != FR_OK) LEAVE_FF(fs, res);
+		rp->size = ld_dword(fp->buf + RG_Size);
+		rp->head = ld_dword(fp->buf + RG_Head);
+		rp->used = ld_dword(fp->buf + RG_Used);
+		if (ld_dword(fp->buf + RG_Sig) != 0x474E4952 || rp->size == 0 || rp->size % SS(fs) != 0
+			|| fp->obj.objsize != (FSIZE_t)SS(fs) + rp->size || rp->head >= rp->size || rp->used > rp->size) {
+			LEAVE_FF(fs, FR_DENIED);	/* Not a ring file */
+		}
+		if (size != 0 && (size + SS(fs) - 1) / SS(fs) * SS(fs) != rp->size) LEAVE_FF(fs, FR_INVALID_PARAMETER);
+		ncl = (DWORD)(((QWORD)SS(fs) + rp->size + bcs - 1) / bcs);
+		for (cl = fp->obj.sclust; --ncl; cl = nxt) {	/* Check if the chain is contiguous */
+			nxt = get_fat(&fp->obj, cl);
+			if (nxt == 0xFFFFFFFF) LEAVE_FF(fs, FR_DISK_ERR);
+			if (nxt != cl + 1) LEAVE_FF(fs, FR_DENIED);
+		}
+	}
+
+	LEAVE_FF(fs, res);
+}
+
+
+
+FRESULT f_ring_open (
+	FFRING* rp,			/* Pointer to the blank ring file object */
+	const TCHAR* path,	/* Pointer to the file name */
+	DWORD size			/* Size of the data area to create the file (0:open existing file only) */
+)
+{
+	FRESULT res;
+
+
+	if (!rp) return FR_INVALID_OBJECT;
+	res = f_open(&rp->fil, path, size ? FA_READ | FA_WRITE | FA_OPEN_ALWAYS : FA_READ | FA_WRITE);
+	if (res != FR_OK) return res;
+	res = ring_init(rp, size);
+	if (res == FR_OK) res = f_sync(&rp->fil);	/* Register the new ring file */
+	if (res != FR_OK) f_close(&rp->fil);
+	return res;
+}
+
+
+
+FRESULT f_ring_write (
+	FFRING* rp,			/* Pointer to the ring file object */
+	const void* buff,	/* Pointer to the data to be written */
+	UINT btw,			/* Number of bytes to write */
+	UINT* bw			/* Pointer to number of bytes written */
+)
+{
+	FRESULT res;
+	FATFS *fs;
+	FIL *fp = &rp->fil;
+	const BYTE *wbuff = (const BYTE*)buff;
+	QWORD sect;
+	UINT wcnt, cc, ofs;
+#ifndef __LITEOS_M__
+	UINT copy_ret;
+#endif
+
+
+	*bw = 0;
+	res = validate(&fp->obj, &fs);
+	if (res != FR_OK || (res = (FRESULT)fp->err) != FR_OK) LEAVE_FF(fs, res);
+
+	if (btw > rp->size) {		/* Only the last part of the data stays in the ring */
+		*bw = btw - rp->size;
+		wbuff += *bw; btw = rp->size;
+	}
+	for ( ; btw; btw -= wcnt, *bw += wcnt, wbuff += wcnt) {
+		sect = rp->sect + rp->head / SS(fs);
+		ofs = rp->head % SS(fs);
+		if (ofs == 0 && btw >= SS(fs)) {	/* Write whole sectors directly */
+			cc = btw / SS(fs);
+			if (cc > (rp->size - rp->head) / SS(fs)) cc = (rp->size - rp->head) / SS(fs);	/* Clip at end of the data area */
+			if (disk_write(fs->pdrv, wbuff, sect, cc) != RES_OK) ABORT(fs, FR_DISK_ERR);
+			if (fp->sect - sect < cc) {		/* Discard the buffered sector overwritten */
+				fp->sect = 0;
+				fp->flag &= (BYTE)~FA_DIRTY;
+			}
+			wcnt = cc * SS(fs);
+		} else {							/* Put a partial sector */
+			res = ring_fill(rp, sect, ofs != 0 || rp->used != rp->head);	/* No read if the rest of the sector holds no data */
+			if (res != FR_OK) ABORT(fs, res);
+			wcnt = SS(fs) - ofs;
+			if (wcnt > btw) wcnt = btw;
+#ifndef __LITEOS_M__
+			copy_ret = LOS_CopyToKernel(fp->buf + ofs, SS(fs) - ofs, wbuff, wcnt);
+			if (copy_ret != EOK) ABORT(fs, FR_INVALID_PARAMETER);
+#else
+			mem_cpy(fp->buf + ofs, wbuff, wcnt);
+#endif
+			fp->flag |= FA_DIRTY;
+		}
+		rp->head += wcnt;
+		if (rp->head == rp->size) rp->head = 0;
+		rp->used = (wcnt < rp->size - rp->used) ? rp->used + wcnt : rp->size;
+	}
+
+	LEAVE_FF(fs, FR_OK);
+}
+
+
+
+FRESULT f_ring_read (
+	FFRING* rp,			/* Pointer to the ring file object */
+	DWORD ofs,			/* Offset from the oldest data held */
+	void* buff,			/* Pointer to data buffer */
+	UINT btr,			/* Number of bytes to read */
+	UINT* br			/* Pointer to number of bytes read */
+)
+{
+	FRESULT res;
+	FATFS *fs;
+	FIL *fp = &rp->fil;
+	BYTE *rbuff = (BYTE*)buff;
+	QWORD sect;
+	DWORD pos;
+	UINT rcnt, cc, so;
+#ifndef __LITEOS_M__
+	UINT copy_ret;
+#endif
+
+
+	*br = 0;
+	res = validate(&fp->obj, &fs);
+	if (res != FR_OK || (res = (FRESULT)fp->err) != FR_OK) LEAVE_FF(fs, res);
+	if (ofs >= rp->used) LEAVE_FF(fs, FR_OK);
+	if (btr > rp->used - ofs) btr = rp->used - ofs;
+
+	pos = (rp->head >= rp->used) ? rp->head - rp->used : rp->head + (rp->size - rp->used);	/* Offset of the oldest data */
+	pos = (ofs < rp->size - pos) ? pos + ofs : ofs - (rp->size - pos);
+	for ( ; btr; btr -= rcnt, *br += rcnt, rbuff += rcnt) {
+		sect = rp->sect + pos / SS(fs);
+		so = pos % SS(fs);
+		if (so == 0 && btr >= SS(fs) && fp->sect != sect) {	/* Read whole sectors directly */
+			cc = btr / SS(fs);
+			if (cc > (rp->size - pos) / SS(fs)) cc = (rp->size - pos) / SS(fs);	/* Clip at end of the data area */
+			if (disk_read(fs->pdrv, rbuff, sect, cc) != RES_OK) ABORT(fs, FR_DISK_ERR);
+			if ((fp->flag & FA_DIRTY) && fp->sect - sect < cc) {	/* Replace the sector with the dirty one in the buffer */
+#ifndef __LITEOS_M__
+				copy_ret = LOS_CopyFromKernel(rbuff + ((fp->sect - sect) * SS(fs)), SS(fs), fp->buf, SS(fs));
+				if (copy_ret != EOK) ABORT(fs, FR_INVALID_PARAMETER);
+#else
+				mem_cpy(rbuff + ((fp->sect - sect) * SS(fs)), fp->buf, SS(fs));
+#endif
+			}
+			rcnt = cc * SS(fs);
+		} else {							/* Get a partial sector */
+			res = ring_fill(rp, sect, 1);
+			if (res != FR_OK) ABORT(fs, res);
+			rcnt = SS(fs) - so;
+			if (rcnt > btr) rcnt = btr;
+#ifndef __LITEOS_M__
+			copy_ret = LOS_CopyFromKernel(rbuff, rcnt, fp->buf + so, rcnt);
+			if (copy_ret != EOK) ABORT(fs, FR_INVALID_PARAMETER);
+#else
+			mem_cpy(rbuff, fp->buf + so, rcnt);
+#endif
+		}
+		pos += rcnt;
+		if (pos == rp->size) pos = 0;
+	}
+
+	LEAVE_FF(fs, FR_OK);
+}
+
+
+
+FRESULT f_ring_sync (
+	FFRING* rp			/* Pointer to the ring file object */
+)
+{
+	FRESULT res;
+	FATFS *fs;
+
+
+	res = validate(&rp->fil.obj, &fs);
+	if (res == FR_OK) res = ring_save(rp);
+	LEAVE_FF(fs, res);
+}
+
+
+
+FRESULT f_ring_close (
+	FFRING* rp			/* Pointer to the ring file object */
+)
+{
+	FRESULT res;
+
+
+	res = f_ring_sync(rp);
+	if (res == FR_OK) res = f_close(&rp->fil);
+	return res;
+}
+
+#endif /* FF_USE_RING && !FF_FS_READONLY && !FF_FS_TINY */
+
+
+
 #if FF_USE_FORWARD
 /*-----------------------------------------------------------------------*/
 /* Forward Data to the Stream Directly                                   */
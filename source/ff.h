@@ -60,7 +60,12 @@ extern "C" {
 static const BYTE LfnOfs[] = {1,3,5,7,9,14,16,18,20,22,24,28,30};	/* FAT: Offset of LFN characters in the directory entry */
 
 #if FF_USE_LFN == 1		/* LFN enabled with static working buffer */
+#if FF_VOL_LOCAL
+#define LFNBUF(fs)		((fs)->lfnwork)	/* LFN working buffer of the volume */
+#else
 static WCHAR LfnBuf[FF_MAX_LFN + 1];		/* LFN working buffer */
+#define LFNBUF(fs)		LfnBuf
+#endif
 #define DEF_NAMBUF
 #define INIT_NAMBUF(fs)
 #define FREE_NAMBUF()
@@ -84,6 +89,9 @@ static WCHAR LfnBuf[FF_MAX_LFN + 1];		/* LFN working buffer */
 
 #endif	/* FF_USE_LFN == 1 */
 #endif	/* FF_USE_LFN == 0 */
+#ifndef MAX_MALLOC
+#define MAX_MALLOC	0x8000	/* Max size of a temporary buffer for multi-sector write */
+#endif
 
 
 #define NS_NONAME	0x80	/* Not followed */
@@ -208,6 +216,39 @@ typedef DWORD FSIZE_t;
 
 extern UINT	time_status;
 
+/* Operation types of the volume hold statistics (f_getholdstat) */
+#define HS_GETFREE	0	/* FAT scan in f_getfree() */
+#define HS_REMOVE	1	/* Cluster chain removal in f_unlink() and f_truncate() */
+#define HS_EXPAND	2	/* Contiguous cluster search in f_expand() */
+#define HS_NOP		3	/* Number of operation types */
+
+/* File I/O counters (f_getfilestats) */
+typedef struct {
+	QWORD	rd_bytes;		/* Bytes read by the application */
+	QWORD	wr_bytes;		/* Bytes written by the application */
+	DWORD	dat_read;		/* Sectors of file data read */
+	DWORD	dat_write;		/* Sectors of file data written */
+	DWORD	part_acc;		/* Accesses to a part of a sector through the file buffer */
+	DWORD	buf_fill;		/* Sectors loaded into the file buffer for the partial accesses */
+	DWORD	fat_get;		/* Cluster links followed */
+	DWORD	clst_alloc;		/* Clusters allocated to the file */
+	DWORD	io_tick;		/* Time spent in the disk functions [tick] */
+	DWORD	dir;			/* Start cluster of the directory containing the file (0:root) */
+} FFFSTAT;
+
+#if FF_FS_LOCK != 0
+/* File lock semaphore structure (FILESEM) */
+
+typedef struct {
+	void*	fs;		/* Object ID 1, volume (NULL:blank entry) */
+	DWORD	clu;	/* Object ID 2, containing directory (0:root) */
+	DWORD	ofs;	/* Object ID 3, offset in the directory */
+	WORD	ctr;	/* Object open counter, 0:none, 0x01..0xFF:read mode open count, 0x100:write mode */
+} FILESEM;
+#endif
+
+
+
 /* Filesystem object structure (FATFS) */
 
 typedef struct {
@@ -225,15 +266,56 @@ typedef struct {
 #if FF_USE_LFN
 	WCHAR*	lfnbuf;			/* LFN working buffer */
 #endif
+#if FF_USE_LFN == 1 && FF_VOL_LOCAL
+	WCHAR	lfnwork[FF_MAX_LFN + 1];	/* LFN working buffer of the volume */
+#endif
+#if FF_FS_LOCK != 0 && FF_VOL_LOCAL
+	FILESEM	files[FF_FS_LOCK];	/* Open object lock semaphores of the volume */
+#endif
 #if FF_FS_REENTRANT
 	FF_SYNC_t	sobj;		/* Identifier of sync object */
+#if FF_FS_MAXHOLD
+	BYTE	hop;			/* Operation type holding the volume with yield points (0:none, HS_xxx + 1) */
+	BYTE	hdepth;			/* Number of times the volume is locked by the current owner */
+	DWORD	htick;			/* Time tick the volume has been locked at */
+	DWORD	modcnt;			/* Number of FAT changes */
+	DWORD	hmax[HS_NOP];	/* Longest hold time of each operation type */
+#endif
 #endif
 #if !FF_FS_READONLY
 	DWORD	last_clst;		/* Last allocated cluster */
 	DWORD	free_clst;		/* Number of free clusters */
 #endif
+#if !FF_FS_READONLY && FF_ALLOC_NEAR
+	BYTE	alloc_near;		/* Allocation policy (0:from the last allocated cluster, 1:near the directory) */
+#endif
+#if !FF_FS_READONLY && FF_ALLOC_ZONE
+	BYTE	zn_full;		/* Zones found full (bit0:small file zone, bit1:large file zone) */
+	DWORD	zn_last[2];		/* Cluster to start to find in each zone */
+#endif
+#if !FF_FS_READONLY && FF_USE_FREEMAP
+	BYTE	fm_csh;			/* Clusters per bit of fmap[] in power of 2 */
+	BYTE	fm_dirty;		/* The FAT has been changed since the volume was mounted */
+	QWORD	fm_sect;		/* Sector of the valid snapshot to be invalidated at first change of the FAT (0:none) */
+	BYTE	fmap[FF_MIN_SS - 32];	/* Free cluster map (1 bit per region, 0:no free cluster in the region) */
+#endif
+#if !FF_FS_READONLY && FF_USE_TRIM && FF_TRIM_QUEUE
+	UINT	tq_n;			/* Number of blocks in the trim queue */
+	DWORD	tq_gran;		/* Trim granularity (erase block size in unit of sector) */
+	DWORD	tq_blk[FF_TRIM_QUEUE][2];	/* Freed blocks to be trimmed {first, last cluster} in order of cluster */
+	DWORD	tq_stat[4];		/* Number of blocks queued, merged, trimmed and dropped */
+#endif
+#if !FF_FS_READONLY && FF_USE_DIRINDEX
+	BYTE	dx_stat;		/* Status of the directory index (0:not created, 1:available, 2:not available) */
+	QWORD	dx_sect;		/* Sector of the directory index header */
+	BYTE	dx_map[64];		/* Directories which have entries in the index (1 bit per hash of start cluster) */
+#endif
 #if FF_FS_RPATH
 	DWORD	cdir;			/* Current directory start cluster (0:root) */
+#endif
+#if FF_FS_RPATH >= 2 && FF_CWD_CACHE
+	DWORD	cwdclst;		/* Current directory the cached path belongs to (0xFFFFFFFF:invalid) */
+	TCHAR	cwdpath[FF_CWD_CACHE];	/* Cached path name of current directory ("" at root) */
 #endif
 	DWORD	n_fatent;		/* Number of FAT entries, = number of clusters + 2 */
 	DWORD	fsize;			/* Sectors per FAT */
@@ -294,12 +376,21 @@ typedef struct {
 	QWORD	dir_sect;		/* Sector number containing the directory entry */
 	BYTE*	dir_ptr;		/* Pointer to the directory entry in the win[] */
 #endif
+#if !FF_FS_READONLY && FF_USE_STREAM
+	BYTE	st_mode;		/* Streaming mode (0:off, 1:on, 2:closing) */
+	FSIZE_t	st_size;		/* File size at the last directory entry update */
+	DWORD	st_time;		/* Time of the last directory entry update (in unit of second) */
+#endif
 #if FF_USE_FASTSEEK
 	DWORD*	cltbl;			/* Pointer to the cluster link map table (nulled on open, set by application) */
 #endif
 #if !FF_FS_TINY
 	BYTE*	buf;			/* File private data read/write window */
 #endif
+#if FF_USE_FILESTAT
+	FFFSTAT	fst;			/* I/O counters of the file */
+	DWORD	fst_tick;		/* Time tick the last disk function was called at */
+#endif
 #ifndef __LITEOS_M__
 	LOS_DL_LIST fp_entry;
 #endif
@@ -327,6 +418,32 @@ struct __dirstream {
 #endif
 };
 
+#if FF_USE_BATCH
+/* Batch object structure (FFBATCH) */
+
+typedef struct {
+	DIR		dir;			/* Target directory */
+	DWORD	eot;			/* Offset of the entry next to the last entry in use */
+	DWORD	rs;				/* First cluster of the reserved run */
+	DWORD	cur;			/* Next cluster to be taken from the run */
+	DWORD	re;				/* End of the run (next to the last cluster) */
+	BYTE*	buf;			/* Sector buffer for the last sector of the files */
+	BYTE	flt[FF_BATCH_FILTER];		/* Filter of the names in the directory */
+} FFBATCH;
+#endif
+
+#if FF_USE_RING
+/* Ring file object structure (FFRING) */
+
+typedef struct {
+	FIL		fil;			/* File object of the ring file */
+	QWORD	sect;			/* Top sector of the data area */
+	DWORD	size;			/* Size of the data area */
+	DWORD	head;			/* Offset in the data area to be written next */
+	DWORD	used;			/* Amount of data held in the ring */
+} FFRING;
+#endif
+
 /* File information structure (FILINFO) */
 
 typedef struct {
@@ -423,19 +540,68 @@ FRESULT f_findfirst (DIR* dp, FILINFO* fno, const TCHAR* path, const TCHAR* patt
 FRESULT f_findnext (DIR* dp, FILINFO* fno);							/* Find next file */
 FRESULT f_mkdir (const TCHAR* path);								/* Create a sub directory */
 FRESULT f_unlink (const TCHAR* path);								/* Delete an existing file or directory */
+#if FF_USE_UNLINK_MANY
+FRESULT f_unlink_many (const TCHAR* path, const TCHAR* const* names, UINT cnt, BYTE opt, UINT* ndel);	/* Delete the matching files in a directory */
+#endif
+#if FF_USE_RMTREE
+FRESULT f_rmtree (const TCHAR* path, BYTE opt);						/* Delete a directory tree */
+#endif
+#if FF_USE_BATCH
+FRESULT f_batch_begin (FFBATCH* bt, const TCHAR* path);				/* Start to create files in a directory */
+FRESULT f_batch_create (FFBATCH* bt, const TCHAR* name, const void* buff, UINT btw);	/* Create a file in the batch */
+FRESULT f_batch_commit (FFBATCH* bt);								/* Finish the batch (always needed after f_batch_begin) */
+#endif
 FRESULT f_rename (const TCHAR* path_old, const TCHAR* path_new);	/* Rename/Move a file or directory */
+#if FF_USE_REPLACE
+FRESULT f_replace (const TCHAR* path_src, const TCHAR* path_dst, BYTE opt);	/* Replace a file with another file */
+#endif
 FRESULT f_stat (const TCHAR* path, FILINFO* fno);					/* Get file status */
+#if FF_USE_OPENAT
+FRESULT f_open_at (FIL* fp, DIR* dp, const TCHAR* name, BYTE mode);	/* Open or create a file in an open directory */
+FRESULT f_stat_at (DIR* dp, const TCHAR* name, FILINFO* fno);		/* Get file status in an open directory */
+FRESULT f_unlink_at (DIR* dp, const TCHAR* name);					/* Delete a file or directory in an open directory */
+FRESULT f_mkdir_at (DIR* dp, const TCHAR* name);					/* Create a sub directory in an open directory */
+#endif
+#if FF_USE_MKDIRS
+FRESULT f_mkdirs (const TCHAR* path);								/* Create a directory and its missing parents */
+#endif
+#if FF_USE_LFN && FF_DIR_ALIGN
+FRESULT f_getdirblk (const TCHAR* path, UINT* nblk, UINT* nstr);	/* Count LFN entry blocks across sectors in a directory */
+#endif
 FRESULT f_chmod (const TCHAR* path, BYTE attr, BYTE mask);			/* Change attribute of a file/dir */
 FRESULT f_utime (const TCHAR* path, const FILINFO* fno);			/* Change timestamp of a file/dir */
 FRESULT f_chdir (const TCHAR* path);								/* Change current directory */
 FRESULT f_chdrive (const TCHAR* path);								/* Change current drive */
 FRESULT f_getcwd (TCHAR* buff, UINT len);							/* Get current directory */
 FRESULT f_getfree (const TCHAR* path, DWORD* nclst, FATFS** fatfs);	/* Get number of free clusters on the drive */
+#if FF_FS_REENTRANT && FF_FS_MAXHOLD
+FRESULT f_getholdstat (const TCHAR* path, BYTE op, DWORD* tmax, BYTE clr);	/* Get the longest hold time of the volume */
+#endif
+#if FF_USE_TRIM && FF_TRIM_QUEUE
+FRESULT f_flushtrim (const TCHAR* path);							/* Trim the queued blocks */
+FRESULT f_gettrimstat (const TCHAR* path, DWORD* st, BYTE clr);	/* Get statistics of the trim queue */
+#endif
+#if FF_USE_FILESTAT
+FRESULT f_getfilestats (FIL* fp, FFFSTAT* st, BYTE clr);			/* Get I/O counters of the file */
+#endif
 FRESULT f_getlabel (const TCHAR* path, TCHAR* label, DWORD* vsn);	/* Get volume label */
 FRESULT f_setlabel (const TCHAR* label);							/* Set volume label */
 FRESULT f_forward (FIL* fp, UINT(*func)(const BYTE*,UINT), UINT btf, UINT* bf);	/* Forward data to the stream */
 FRESULT f_expand (FIL* fp, FSIZE_t offset, FSIZE_t fsz, int opt);	/* Allocate a contiguous block to the file */
+#if FF_USE_COLLAPSE
+FRESULT f_collapse_head (FIL* fp, FSIZE_t bytes);					/* Remove leading clusters of the file */
+#endif
+#if FF_USE_RING
+FRESULT f_ring_open (FFRING* rp, const TCHAR* path, DWORD size);	/* Open or create a ring file */
+FRESULT f_ring_write (FFRING* rp, const void* buff, UINT btw, UINT* bw);	/* Append data to the ring file */
+FRESULT f_ring_read (FFRING* rp, DWORD ofs, void* buff, UINT btr, UINT* br);	/* Read data held in the ring file */
+FRESULT f_ring_sync (FFRING* rp);									/* Save the state of the ring file */
+FRESULT f_ring_close (FFRING* rp);									/* Close the ring file */
+#endif
 FRESULT f_mount (FATFS* fs, const TCHAR* path, BYTE opt);			/* Mount/Unmount a logical drive */
+#if FF_USE_WARMUP && !defined(__LITEOS_M__)
+FRESULT f_warmup (const TCHAR* path, const TCHAR* const* dirs, UINT ndir);	/* Read ahead the FAT and hot directories of the volume */
+#endif
 FRESULT f_mkfs (const TCHAR* path, BYTE opt, int sector, void* work, UINT len);	/* Create a FAT volume */
 FRESULT f_fdisk (BYTE pdrv, const DWORD* szt, void* work);			/* Divide a physical drive into some partitions */
 
@@ -515,6 +681,9 @@ DWORD ff_wtoupper (DWORD uni);			/* Unicode upper-case conversion */
 
 void* ff_memalloc (UINT msize);			/* Allocate memory block */
 void ff_memfree (void* mblock);			/* Free memory block */
+#if FF_USE_FILESTAT == 2
+void ff_filestat (FATFS* fs, const FFFSTAT* st);	/* Take I/O counters of the file being closed */
+#endif
 #ifndef __LITEOS_M__
 int ff_strnlen(const void *str, size_t maxlen);
 #endif
@@ -526,6 +695,9 @@ int ff_req_grant (FF_SYNC_t* sobj);		/* Lock sync object */
 void ff_rel_grant (FF_SYNC_t* sobj);		/* Unlock sync object */
 int ff_del_syncobj (FF_SYNC_t* sobj);	/* Delete a sync object */
 #endif
+#if (FF_FS_REENTRANT && FF_FS_MAXHOLD) || FF_USE_FILESTAT
+DWORD ff_get_tick (void);				/* Get current time tick */
+#endif
 
 
 
@@ -542,6 +714,20 @@ int ff_del_syncobj (FF_SYNC_t* sobj);	/* Delete a sync object */
 #define	FA_CREATE_ALWAYS	0x08
 #define	FA_OPEN_ALWAYS		0x10
 #define	FA_OPEN_APPEND		0x30
+#define	FA_STREAM			0x40
+
+/* Mount options (3rd argument of f_mount) */
+#define MT_NEAR		0x02	/* Allocate a new chain near its directory (FF_ALLOC_NEAR) */
+
+/* Bulk delete options (4th argument of f_unlink_many) */
+#define UM_STRICT	0x01	/* Abort at the first matching file that cannot be removed */
+#define UM_FORCE	0x02	/* Remove read-only files as well */
+
+/* Tree removal options (2nd argument of f_rmtree) */
+#define RT_CONTENT	0x01	/* Remove the contents and leave the directory itself */
+
+/* Replace options (3rd argument of f_replace) */
+#define RP_DEFER	0x01	/* Free the old content after the directory is committed */
 
 /* Fast seek controls (2nd argument of f_lseek) */
 #define CREATE_LINKMAP	((FSIZE_t)0 - 1)
@@ -69,6 +69,15 @@ extern "C" {
 /* This option switches f_expand function. (0:Disable or 1:Enable) */
 
 
+#define FF_USE_COLLAPSE	0
+/* This option switches f_collapse_head() function, which removes leading clusters
+/  of a file by moving the top of the file in its directory entry and freeing the
+/  clusters removed, without copying the data left. (0:Disable or 1:Enable)
+/  The number of bytes removed must be a multiple of the cluster size. The file
+/  pointer is moved back by the bytes removed and the fast seek link map of the
+/  file needs to be created again. */
+
+
 #ifndef __LITEOS_M__
 #define FF_USE_CHMOD	1
 #else
@@ -91,6 +100,102 @@ extern "C" {
 /* This option switches f_forward() function. (0:Disable or 1:Enable) */
 
 
+#define FF_USE_UNLINK_MANY	0
+/* This option switches f_unlink_many() function, which removes the files matching
+/  a list of names or wildcard patterns from a directory in a single pass.
+/  (0:Disable or 1:Enable) Also FF_FS_READONLY and FF_FS_MINIMIZE need to be 0
+/  to enable this option. */
+
+
+#define FF_USE_RMTREE	0
+/* This option switches f_rmtree() function, which removes a directory tree in a
+/  single walk. (0:Disable or 1:Enable) Also FF_FS_READONLY and FF_FS_MINIMIZE
+/  need to be 0 to enable this option. */
+
+
+#define FF_USE_MKDIRS	0
+/* This option switches f_mkdirs() function, which creates a directory and its
+/  missing parents in a single walk of the path. (0:Disable or 1:Enable) Also
+/  FF_FS_READONLY and FF_FS_MINIMIZE need to be 0 to enable this option. */
+
+
+#define FF_USE_REPLACE	0
+/* This option switches f_replace() function, which replaces a file with another
+/  file in the same volume, e.g. a temporary file written in advance, with a
+/  single commit of the directory. The target entry takes over the content of the
+/  source file, the source entry is removed and the old content is freed. With
+/  RP_DEFER option, the old content is freed after the commit and the FAT change
+/  is written back at next sync, so that an interruption can leave only lost
+/  clusters. (0:Disable or 1:Enable) Also FF_FS_READONLY and FF_FS_MINIMIZE need
+/  to be 0 to enable this option. */
+
+
+#define FF_USE_BATCH	0
+#define FF_BATCH_CLST	64
+#define FF_BATCH_FILTER	256
+/* This option switches batched file creation functions, f_batch_begin(),
+/  f_batch_create() and f_batch_commit(). (0:Disable or 1:Enable) Also
+/  FF_FS_READONLY and FF_FS_MINIMIZE need to be 0 to enable this option.
+/  FF_BATCH_CLST defines number of clusters reserved for the files at a time. It
+/  also limits the size of a file created in the batch.
+/  FF_BATCH_FILTER defines size of the name filter in unit of byte which is used to
+/  skip the directory scan for name collision. These buffers are placed in the
+/  batch object (FFBATCH). f_batch_commit() must be called for every batch that
+/  f_batch_begin() opened, even when f_batch_create() failed, to release the
+/  buffer, the lock entry and the unused clusters in the reserved run. */
+
+
+#define FF_USE_OPENAT	0
+/* This option switches directory relative functions, f_open_at(), f_stat_at(),
+/  f_unlink_at() and f_mkdir_at(), which take a name relative to an open directory
+/  object and skip the drive prefix parsing and the look up of the parent
+/  directories. (0:Disable or 1:Enable) f_stat_at(), f_unlink_at() and
+/  f_mkdir_at() are available only if the corresponding path functions are. */
+
+
+#define FF_USE_STREAM	0
+#define FF_STREAM_SYNC	65536
+#define FF_STREAM_TIME	10
+#define FF_STREAM_AHEAD	16
+/* This option switches the streaming mode of the file opened with FA_STREAM
+/  flag, which is given with FA_WRITE and FA_OPEN_APPEND for a log file.
+/  (0:Disable or 1:Enable) The stream is append-only. The cluster chain is
+/  extended by FF_STREAM_AHEAD clusters at a time, and the data in contiguous
+/  clusters are written in a single transfer. f_sync() flushes the data and the
+/  FAT, but rewrites the directory entry only when FF_STREAM_SYNC bytes have been
+/  written or FF_STREAM_TIME seconds have passed (0:no time limit) since the last
+/  update. f_close() updates the entry and releases the unused clusters.
+/  After a power failure, the file size is the one at the last update, so that
+/  the data written after it are out of the file, and the cluster chain may be
+/  longer than the size. The clusters beyond the size belong to the file and are
+/  released by f_truncate() or next f_close() in streaming mode. Also
+/  FF_FS_READONLY needs to be 0 to enable this option. */
+
+
+#define FF_USE_RING	0
+/* This option switches ring file functions, f_ring_open(), f_ring_write(),
+/  f_ring_read(), f_ring_sync() and f_ring_close(), which keep the last data
+/  written in a fixed-size file allocated in contiguous clusters. (0:Disable or
+/  1:Enable) The ring file has a header sector with the write offset and the
+/  amount of data, and the data written are put on the sectors computed from the
+/  offset without cluster allocation or directory entry update. The header is
+/  written by f_ring_sync() and f_ring_close(), so that the ring returns to the
+/  state at last sync after a power failure. Also FF_FS_READONLY and FF_FS_TINY
+/  need to be 0 to enable this option. */
+
+
+#define FF_USE_WARMUP	0
+#define FF_WARMUP_FAT	32
+/* This option switches f_warmup() function, which reads the head of the FAT, the
+/  FAT sectors around the free cluster hint, the root directory and a list of hot
+/  directories in large blocks after the volume is mounted. (0:Disable or
+/  1:Enable) It is useful only when the disk functions have a block cache, and it
+/  can be called from a background task at thread-safe configuration.
+/  FF_WARMUP_FAT defines number of FAT sectors read at each of the two regions.
+/  The function is not available on LiteOS-M, which has no block cache and whose
+/  ff_memalloc() cannot serve the multi-sector buffer. */
+
+
 /*---------------------------------------------------------------------------/
 / Locale and Namespace Configurations
 /---------------------------------------------------------------------------*/
@@ -205,6 +310,15 @@ enum STORAGE {
 */
 
 
+#define FF_CWD_CACHE	0
+/* This option defines size of the buffer in unit of TCHAR to cache the path name
+/  of current directory in the filesystem object. f_chdir() updates the path as it
+/  moves the current directory and f_getcwd() returns it without scanning the
+/  parent directories. (0:Disable or >0:Enable) It is effective when FF_FS_RPATH
+/  is 2. The cache is discarded when a sub-directory is renamed or the path does
+/  not fit in the buffer, and it is rebuilt by the next f_getcwd(). */
+
+
 /*---------------------------------------------------------------------------/
 / Drive/Volume Configurations
 /---------------------------------------------------------------------------*/
@@ -273,6 +387,99 @@ enum STORAGE {
 /  disk_ioctl() function. */
 
 
+#define FF_TRIM_QUEUE	0
+/* This option defines the number of freed blocks queued per volume to be trimmed
+/  later. (0:Trim each block when it is freed or >=1:Queue the blocks)
+/  The blocks freed by deletes are merged with the adjacent blocks in the queue,
+/  and are trimmed at once when a modified file is synchronized by f_sync() or
+/  f_close(), when f_flushtrim() is called at idle time or when the volume is
+/  unmounted. The largest block is trimmed when the queue overflows. A block is
+/  clipped to the erase block size given by GET_BLOCK_SIZE command and dropped
+/  if it has no whole erase block. The counts of the blocks queued, merged,
+/  trimmed and dropped can be read with f_gettrimstat(). This option has no
+/  effect at FF_USE_TRIM == 0. */
+
+
+#define FF_DSTATUS_CACHE	0
+/* This option switches caching of the drive status in disk_status(). (0:Disable
+/  or >=1:Enable) When enabled, the driver is asked for the status only after it
+/  reports a change of the medium (removal, insertion or write protection) with
+/  disk_notify(), or after the cached status has been returned FF_DSTATUS_CACHE
+/  times. Set a large value if the driver always calls disk_notify(). This option
+/  takes effect at LiteOS-M only, disk_status() does not query the driver on the
+/  other port. */
+
+
+#define FF_DIR_ALIGN	0
+/* This option switches sector-aware placement of the directory entry block of
+/  LFN and SFN. (0:Disable or >=1:Enable) When the first free block found would
+/  be across two sectors, the search continues up to this number of sectors to
+/  find a free block in a sector, and takes the first one if not found. The
+/  entry of a file in a sector is updated with one sector write. The number of
+/  blocks across sectors in a directory can be counted with f_getdirblk(), which
+/  is available only when this option is enabled and FF_USE_LFN >= 1. */
+
+
+#define FF_FS_LOOPCHK	0
+/* This option switches detection of a circular cluster chain on the broken FAT.
+/  (0:Disable or 1:Enable) Every cluster chain walk is stopped with FR_INT_ERR
+/  when it follows more links than the number of clusters in the volume. When
+/  this option is enabled, a circular chain is also detected with Brent's method
+/  within a few times the loop length, so that a long walk on a large volume is
+/  not needed to report the error. */
+
+
+#define FF_USE_FREEMAP	0
+/* This option switches the free cluster map. (0:Disable or 1:Enable)
+/  When enabled, each volume has a map with a bit per region of clusters which
+/  tells the region has no free cluster, and the cluster allocation skips such
+/  regions without reading their FAT sectors. The map is saved with the number
+/  of free clusters in a hidden system file FREEMAP.SYS in the root directory when
+/  the volume is unmounted by f_mount() after the FAT has been changed, and is
+/  taken at next mount if the FAT has not been changed since then, so that the
+/  number of free clusters is known without the full FAT scan also on the volume
+/  without FSInfo. No snapshot is taken on the FAT12 volume, and an error on
+/  saving the map does not fail the unmount. */
+
+
+#define FF_ALLOC_NEAR	0
+/* This option switches the near allocation policy. (0:Disable or 1:Enable)
+/  When enabled, a volume mounted by f_mount() with MT_NEAR (0x02) in the option
+/  starts the search for the first cluster of a new file or directory at the
+/  cluster of its directory instead of the last allocated cluster, and a chain
+/  which cannot be stretched contiguously continues at the free cluster next to
+/  its end. It reduces the seeks between the directory and the data on the slow
+/  media. This option has no effect at read-only configuration. */
+
+
+#define FF_ALLOC_ZONE	0
+#define FF_ZONE_LARGE	0x100000
+/* FF_ALLOC_ZONE switches the size-class allocation zones and specifies the size
+/  of the small file zone in percent of the data area. (0:Disable or 1-99)
+/  When enabled, the data area is divided into the small file zone at its top and
+/  the large file zone after that. A new cluster of a file is searched in the
+/  large file zone when the file is going to reach FF_ZONE_LARGE bytes by the
+/  f_write(), f_lseek() or f_expand() in progress or it is a stream, and in the
+/  small file zone otherwise, so that the small files created and removed
+/  frequently do not fragment the free space for the large files. A chain is not
+/  stretched across the zone boundary and the search falls back to the entire
+/  volume when the zone is full. The zone takes precedence over FF_ALLOC_NEAR.
+/  The virtual partitions are not divided. */
+
+
+#define FF_USE_DIRINDEX	0
+/* This option switches the directory index and specifies its size in unit of
+/  sector. (0:Disable or 16-4096)
+/  When enabled, the location of entries created deep in directories is recorded
+/  in a hash table kept in a hidden system file DIRINDEX.SYS in the root
+/  directory, and following lookups of the names, also after next mount, take a
+/  few sector reads instead of a scan of the directory. Every hit is verified
+/  against the directory and a miss falls back to the scan, so that the index
+/  never gives a wrong result even if the directory has been changed by other
+/  systems. The index is created and updated only by the functions that modify
+/  the directory, lookups never write the volume. */
+
+
 #define FF_FS_NOFSINFO	0
 /* If you need to know correct free space on the FAT32 volume, set bit 0 of this
 /  option, and f_getfree() function at first time after volume mount will force
@@ -353,6 +560,46 @@ enum STORAGE {
 /  included somewhere in the scope of ff.h. */
 
 
+#define FF_VOL_LOCAL	0
+/* This option places the work areas shared by all volumes in each filesystem
+/  object (FATFS) instead, so that the operations on different volumes do not
+/  touch the same data and can run in parallel.
+/
+/   0: The file lock table of FF_FS_LOCK items and the static LFN working buffer
+/      (FF_USE_LFN = 1) are shared by all volumes.
+/   1: Each volume has its own file lock table of FF_FS_LOCK items and LFN working
+/      buffer. The LFN working buffer can be static at thread-safe configuration.
+/      Virtual partitions share the table of the parent volume. */
+
+
+#define FF_FS_MAXHOLD	0
+/* This option defines the maximum time in unit of time tick a long operation
+/  holds the volume at re-entrant configuration. (0:Disable or >=1:Enable)
+/  The FAT scan in f_getfree(), the chain removal in f_unlink() and f_truncate()
+/  and the cluster search in f_expand() release the volume for a moment at a
+/  safe point when they have held it for this time, so that the waiting tasks
+/  can access the volume. The longest hold time of each operation can be read
+/  with f_getholdstat(). When enabled, ff_get_tick() function needs to be added
+/  to the project. This option has no effect at FF_FS_REENTRANT == 0, which is the
+/  case on LiteOS-M (it has no volume lock to release). The volume is released
+/  only if it is locked once at the safe point, so that an operation called with
+/  the volume locked by the caller (recursive mutex on LiteOS-A) is not yielded. */
+
+
+#define FF_USE_FILESTAT	0
+/* This option switches the I/O counters of each file object and f_getfilestats()
+/  function. (0:Disable, 1:Enable or 2:Enable with the close hook)
+/  The file functions count the bytes read and written by the application, the
+/  sectors of file data transferred, the accesses to a part of a sector through
+/  the file buffer and the sectors loaded for them (the difference is the buffer
+/  hits), the cluster links followed, the clusters allocated and the time spent
+/  in the disk functions. Many partial accesses with a high load rate point to
+/  unaligned small reads or writes. When it is 2, ff_filestat() function added
+/  to the project is called with the counters and the directory of the file on
+/  f_close(), e.g. to aggregate them per directory. Also ff_get_tick() function
+/  needs to be added to the project. */
+
+
 
 /*--- End of configuration options ---*/
 
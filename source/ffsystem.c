@@ -10,6 +10,9 @@
 #include "los_memory.h"
 #include "los_membox.h"
 #endif
+#if (FF_FS_REENTRANT && FF_FS_MAXHOLD) || FF_USE_FILESTAT
+#include "los_tick.h"
+#endif
 
 #ifdef __LITEOS_M__
 #define FF_MEM_BLOCK_NUM     (FAT_MAX_OPEN_FILES + FF_VOLUMES)
@@ -189,5 +192,22 @@ void ff_rel_grant (
 #endif
 }
 
+
+#endif
+
+
+#if (FF_FS_REENTRANT && FF_FS_MAXHOLD) || FF_USE_FILESTAT
+/*------------------------------------------------------------------------*/
+/* Get Current Time Tick                                                  */
+/*------------------------------------------------------------------------*/
+/* This function is called to measure the time a file function holds the
+/  volume and the time spent in the disk functions for a file object
+/  (FF_USE_FILESTAT). The unit of the time tick is the same as FF_FS_TIMEOUT.
+*/
+
+DWORD ff_get_tick (void)
+{
+	return (DWORD)LOS_TickCountGet();
+}
 #endif
 